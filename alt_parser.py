@@ -4,12 +4,18 @@ import csv
 import os.path
 import click
 
-MAX_POSITIVE_VALUE = 10
-MIN_NEGATIVE_VALUE = MAX_POSITIVE_VALUE - 15
-
-mode = sys.argv[1]
-
-input_fn = sys.argv[2]
+from log_format import (PROFILED_RECORDER_EEPROM_SIZE, PROFILES, RECORDER_EEPROM_SIZE, describe_header,
+                        fast_interval_secs, feet_per_interval, header_mode, parse_data, slow_interval_secs,
+                        split_log)
+
+# The mode is optional, the summary header records it. --tick-profiler is for dumps from
+# -DTICK_PROFILER_EEPROM builds, whose stats come after the log.
+args = sys.argv[1:]
+size = PROFILED_RECORDER_EEPROM_SIZE if '--tick-profiler' in args else RECORDER_EEPROM_SIZE
+args = [a for a in args if a != '--tick-profiler']
+mode = args.pop(0) if args[0] in PROFILES else None
+
+input_fn = args[0]
 if input_fn == '-':
     bytes = sys.stdin.buffer.read()
     csv_fn = None
@@ -25,38 +31,27 @@ else:
         if not click.confirm(f"Output path {input_fn}.* exists, overwrite?"):
             sys.exit(1)
 
-if len(sys.argv) > 3:
-    xlim, ylim = (int(v) for v in sys.argv[3].split(","))
+if len(args) > 1:
+    xlim, ylim = (int(v) for v in args[1].split(","))
 else:
     xlim = None
     ylim = None
 
-if mode == 'rocket':
-    PA_INTERVAL = 18
-    FAST_INTERVAL_INVERSE_SECS = 8
-    SLOW_INTERVAL_SECS = 1
-    FAST_INTERVAL_RECORDS = 80
-elif mode == 'throw':
-    PA_INTERVAL = 5 # ~1.5'
-    FAST_INTERVAL_INVERSE_SECS = 10
-    SLOW_INTERVAL_SECS = 1
-    FAST_INTERVAL_RECORDS = 200
-elif mode == 'electric':
-    PA_INTERVAL = 17 # ~5'
-    FAST_INTERVAL_INVERSE_SECS = 4
-    SLOW_INTERVAL_SECS = 1
-    FAST_INTERVAL_RECORDS = 40
-elif mode == 'kite':
-    PA_INTERVAL = 11 # ~3'
-    FAST_INTERVAL_INVERSE_SECS = 2
-    SLOW_INTERVAL_SECS = 1
-    FAST_INTERVAL_RECORDS = 256
-else:
-    print("Unknown mode: %s" % mode)
-    sys.exit(1)
+header, _, _ = split_log(bytes)
+if mode is None:
+    mode = header is not None and header_mode(header)
+    if not mode:
+        print("No summary header to say what mode the flight was, give one of: %s" % ", ".join(PROFILES))
+        sys.exit(1)
+elif header is not None and header_mode(header) != mode:
+    print(f"Warning: flight was recorded in {header_mode(header) or header.mode} mode")
 
-FAST_INTERVAL_SECS = 1.0 / FAST_INTERVAL_INVERSE_SECS
-FEET_PER_INTERVAL = (PA_INTERVAL/3.6)
+profile = PROFILES[mode]
+PA_INTERVAL, FAST_INTERVAL_RTC, SLOW_INTERVAL_RTC, FAST_INTERVAL_RECORDS = profile[:4]
+
+FAST_INTERVAL_SECS = fast_interval_secs(profile)
+SLOW_INTERVAL_SECS = slow_interval_secs(profile)
+FEET_PER_INTERVAL = feet_per_interval(profile)
 
 def plot_data(data, xlim, ylim):
     plt_x = []
@@ -81,7 +76,7 @@ def plot_data(data, xlim, ylim):
 
     plt.show()
 
-def write_data(data, csv_fn, txt_fn):
+def write_data(data, header, csv_fn, txt_fn):
     if csv_fn is not None:
         with open(csv_fn, 'w') as csv_f:
             writer = csv.writer(csv_f)
@@ -99,39 +94,18 @@ def write_data(data, csv_fn, txt_fn):
         with open(txt_fn, 'w') as txt_f:
             txt_f.write(f"""
 PA_INTERVAL={PA_INTERVAL}
-FAST_INTERVAL_INVERSE_SECS={FAST_INTERVAL_INVERSE_SECS}
-SLOW_INTERVAL_SECS={SLOW_INTERVAL_SECS}
+FAST_INTERVAL_RTC={FAST_INTERVAL_RTC}
+SLOW_INTERVAL_RTC={SLOW_INTERVAL_RTC}
 FAST_INTERVAL_RECORDS={FAST_INTERVAL_RECORDS}
 FAST_INTERVAL_SECS={FAST_INTERVAL_SECS}
+SLOW_INTERVAL_SECS={SLOW_INTERVAL_SECS}
 FEET_PER_INTERVAL={FEET_PER_INTERVAL}
     """)
+            if header is not None:
+                txt_f.write(f"SUMMARY={describe_header(header, profile)}\n")
 
-def parse_data(bytes):
-    raw_deltas = []
-    for b in bytes:
-        raw_deltas.append((b & 0x0f) + MIN_NEGATIVE_VALUE)
-        raw_deltas.append(((b >> 4) & 0x0f) + MIN_NEGATIVE_VALUE)
-
-    carry = 0
-    deltas = []
-    for rd in raw_deltas:
-        if(rd == MAX_POSITIVE_VALUE or rd == MIN_NEGATIVE_VALUE):
-            carry = carry + rd
-        else:
-            deltas.append(carry + rd)
-            carry = 0
-
-    data = [[0, 0]]
-    for d in deltas:
-        last_t, last_a = data[-1]
-        if(len(data) > FAST_INTERVAL_RECORDS):
-            t_incr = SLOW_INTERVAL_SECS
-        else:
-            t_incr = FAST_INTERVAL_SECS
-        data.append([last_t + t_incr, last_a + d * FEET_PER_INTERVAL])
-
-    return data
-
-data = parse_data(bytes)
-write_data(data, csv_fn, txt_fn)
+if header is not None:
+    print(describe_header(header, profile))
+data = parse_data(bytes, profile, size)
+write_data(data, header, csv_fn, txt_fn)
 plot_data(data, xlim, ylim)
@@ -0,0 +1,160 @@
+"""
+Batch counterpart to alt_parser.py: decodes every raw EEPROM dump in a directory, or
+in a .zip or .tar archive of them, across worker processes. Writes each flight's CSV
+in alt_parser.py's format and an index.csv with its apogee, max ascent rate and
+duration. Each flight in a directory is decoded with the profile alt_parser.py wrote to
+the .txt next to it if there is one; otherwise, and in archives, with the mode in its
+summary header, then --kind. Files alt_parser.py writes next to a dump are skipped.
+
+    pipenv run python batch_parser.py --kind rocket season/ season-out/
+"""
+import csv
+import mmap
+import multiprocessing
+import os
+import sys
+import tarfile
+import time
+import zipfile
+
+import click
+
+from log_format import PROFILES, header_mode, parse_many, read_profile_txt, split_log
+
+# What alt_parser.py leaves next to each dump
+OUTPUT_SUFFIXES = ('.csv', '.txt', '.png')
+# Dumps per task. Small enough that idle workers pick up what's left of a slow one's share.
+CHUNK_FILES = 32
+
+INDEX_FIELDS = ('file', 'mode', 'flight', 'records', 'apogee_ft', 'max_ascent_ft_s', 'duration_s')
+
+
+def is_dump(name):
+    base = os.path.basename(name)
+    return not base.startswith('.') and not base.endswith(OUTPUT_SUFFIXES)
+
+
+def list_dumps(path):
+    """(name, source) for each dump under path, where source is the file to map or,
+    for archive members, the bytes themselves"""
+    if os.path.isdir(path):
+        names = []
+        for root, dirs, files in os.walk(path):
+            dirs[:] = [d for d in dirs if not d.startswith('.')]
+            names += [os.path.relpath(os.path.join(root, f), path) for f in files]
+        return [(n, os.path.join(path, n)) for n in sorted(names) if is_dump(n)]
+    if zipfile.is_zipfile(path):
+        with zipfile.ZipFile(path) as z:
+            return [(i.filename, z.read(i)) for i in z.infolist()
+                    if not i.is_dir() and is_dump(i.filename)]
+    if tarfile.is_tarfile(path):
+        with tarfile.open(path) as t:
+            return [(m.name, t.extractfile(m).read()) for m in t.getmembers()
+                    if m.isfile() and is_dump(m.name)]
+    raise click.BadParameter(f"{path} is not a directory, zip or tar archive")
+
+
+def read_dump(source):
+    if isinstance(source, bytes):
+        return source
+    with open(source, 'rb') as f:
+        if os.fstat(f.fileno()).st_size == 0:
+            return b''
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            return m[:]
+
+
+def dump_profile(name, source, header, kind):
+    """(profile, mode) for a dump: the profile alt_parser.py wrote next to it if there
+    is one, then the mode in its summary header, then kind. Only dumps read from a
+    directory, not archive members, can have a .txt."""
+    mode = (header is not None and header_mode(header)) or kind
+    txt_fn = None if isinstance(source, bytes) else source + '.txt'
+    if txt_fn is not None and os.path.exists(txt_fn):
+        return read_profile_txt(txt_fn), mode
+    if mode is None:
+        raise click.ClickException(f"{name} has no summary header or .txt, give --kind")
+    return PROFILES[mode], mode
+
+
+def summarize(data):
+    """Apogee in feet, max ascent rate in feet per second and duration in seconds"""
+    apogee = max(a for _, a in data)
+    ascent = max(((a1 - a0) / (t1 - t0) for (t0, a0), (t1, a1) in zip(data, data[1:])), default=0)
+    return apogee, ascent, data[-1][0]
+
+
+def write_csv(data, csv_fn):
+    """Same columns and rounding as alt_parser.py"""
+    os.makedirs(os.path.dirname(csv_fn), exist_ok=True)
+    with open(csv_fn, 'w', newline='') as csv_f:
+        writer = csv.writer(csv_f)
+        writer.writerow(('time (secs)', 'altitude (ft)', 'speed (ft/s)'))
+        last_t = -1
+        last_a = 0
+        for (t, a) in data:
+            s = (a - last_a) / (t - last_t)
+            last_t = t
+            last_a = a
+            writer.writerow((t, round(a), round(s)))
+
+
+# Populated in each worker by init_worker
+kind_ = None
+out_dir_ = None
+
+
+def init_worker(kind, out_dir):
+    global kind_, out_dir_
+    kind_, out_dir_ = kind, out_dir
+
+
+def process(chunk):
+    """Index rows for a chunk of (name, source), decoding the dumps of each profile together"""
+    by_profile = {}
+    for name, source in chunk:
+        bytes = read_dump(source)
+        header, flight, _ = split_log(bytes)
+        profile, mode = dump_profile(name, source, header, kind_)
+        by_profile.setdefault(profile, []).append((name, mode, flight, bytes))
+
+    rows = []
+    for profile, dumps in by_profile.items():
+        parsed = parse_many([bytes for _, _, _, bytes in dumps], profile)
+        for (name, mode, flight, _), data in zip(dumps, parsed):
+            write_csv(data, os.path.join(out_dir_, name + '.csv'))
+            apogee, ascent, duration = summarize(data)
+            rows.append((name, mode, flight, len(data) - 1, round(apogee), round(ascent), duration))
+    return rows
+
+
+@click.command()
+@click.option('--kind', type=click.Choice(sorted(PROFILES)), default='rocket',
+              help='Mode for dumps without a summary header or .txt')
+@click.option('--jobs', default=os.cpu_count(), help='Worker processes')
+@click.argument('input', type=click.Path(exists=True))
+@click.argument('output', type=click.Path(file_okay=False))
+def main(kind, jobs, input, output):
+    start = time.monotonic()
+    dumps = list_dumps(input)
+    chunks = [dumps[i:i + CHUNK_FILES] for i in range(0, len(dumps), CHUNK_FILES)]
+
+    os.makedirs(output, exist_ok=True)
+    with multiprocessing.Pool(jobs, init_worker, (kind, output)) as pool:
+        rows = sorted(row for rows in pool.imap_unordered(process, chunks) for row in rows)
+
+    with open(os.path.join(output, 'index.csv'), 'w', newline='') as index_f:
+        writer = csv.writer(index_f)
+        writer.writerow(INDEX_FIELDS)
+        writer.writerows(rows)
+
+    if rows:
+        highest = max(rows, key=lambda r: r[4])
+        print(f"{len(rows)} flights in {time.monotonic() - start:.2f}s, highest {highest[0]} "
+              f"at {highest[4]}ft, fastest ascent {max(r[5] for r in rows)}ft/s", file=sys.stderr)
+    else:
+        print(f"No dumps in {input}", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
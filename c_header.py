@@ -0,0 +1,91 @@
+"""
+Reads constants and struct layouts out of the firmware's headers so the host tools
+decode with exactly what the firmware was built with. Only understands what those
+headers use: #define NAME <integer expression>, #if/#elif NAME == NAME blocks, structs
+of stdint fields and constexpr instances of them with designated initializers.
+"""
+import os
+import re
+import struct
+
+INCLUDE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'include')
+
+STDINT_FORMATS = {
+    'uint8_t': 'B', 'int8_t': 'b',
+    'uint16_t': 'H', 'int16_t': 'h',
+    'uint32_t': 'I', 'int32_t': 'i',
+}
+
+DEFINE_RE = re.compile(r'#define\s+(\w+)\s+(.+)')
+CONDITION_RE = re.compile(r'#(?:el)?if\s+(\w+)\s*==\s*(\w+)')
+FIELD_RE = re.compile(r'(\w+)\s+(\w+);')
+DESIGNATOR_RE = re.compile(r'\.(\w+)\s*=\s*([^,]+)')
+
+
+def _read(name):
+    with open(os.path.join(INCLUDE_DIR, name)) as f:
+        text = f.read()
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    return re.sub(r'//[^\n]*', '', text)
+
+
+def _evaluate(expr, known):
+    """C integer expression to int, or None if it uses anything we don't know"""
+    expr = re.sub(r'\b(0x[0-9a-fA-F]+|\d+)[uUlL]*\b', r'\1', expr)
+    names = set(re.findall(r'\b[A-Za-z_]\w*', expr))
+    if any(n not in known for n in names) or not re.fullmatch(r'[\w\s()+\-*/<>|&~^]+', expr):
+        return None
+    # Only ever positive here, where C and Python division agree
+    return int(eval(expr.replace('/', '//'), {'__builtins__': {}}, known))
+
+
+def defines(name, known=None):
+    """{NAME: value} for every #define in include/name with an integer value, outside
+    any #if block"""
+    return conditional_defines(name, known)[None]
+
+
+def conditional_defines(name, known=None):
+    """As defines, plus {(NAME, VALUE_NAME): {NAME: value}} for each #if NAME == VALUE_NAME
+    or #elif block. Defines inside a block can use the ones outside it."""
+    known = dict(known or {})
+    sections = {None: {}}
+    current = None
+    for line in _read(name).splitlines():
+        line = line.strip()
+        condition = CONDITION_RE.match(line)
+        if condition:
+            current = condition.groups()
+            sections[current] = {}
+        elif line.startswith('#endif'):
+            current = None
+        elif line.startswith('#if'):
+            # Include guards and #ifndef defaults, which are outside any block
+            pass
+        else:
+            define = DEFINE_RE.match(line)
+            if define:
+                scope = {**known, **sections[None], **sections[current]}
+                value = _evaluate(define.group(2), scope)
+                if value is not None:
+                    sections[current][define.group(1)] = value
+    return sections
+
+
+def struct_layout(name, struct_name):
+    """(struct.Struct, field names) for a packed struct in include/name"""
+    body = re.search(r'struct\s+%s\s*\{(.*?)\};' % struct_name, _read(name), re.S).group(1)
+    fields = FIELD_RE.findall(body)
+    return (struct.Struct('<' + ''.join(STDINT_FORMATS[t] for t, _ in fields)),
+            tuple(n for _, n in fields))
+
+
+def struct_instances(name, struct_name, known=None):
+    """{instance name: {field: value}} for each constexpr struct_name in include/name,
+    evaluating its designated initializer with known and the file's own defines"""
+    text = _read(name)
+    known = {**(known or {}), **defines(name, known)}
+    instances = {}
+    for instance, body in re.findall(r'constexpr\s+%s\s+(\w+)\s*=\s*\{(.*?)\};' % struct_name, text, re.S):
+        instances[instance] = {field: _evaluate(expr, known) for field, expr in DESIGNATOR_RE.findall(body)}
+    return instances
@@ -0,0 +1,184 @@
+"""
+Launch detector benchmark: trigger latency against pad false-trigger rate for the
+CUSUM detector in launch_detector.cpp over a grid of drift and threshold, with the
+old single-pair comparison for reference. Runs the firmware model in flight_sim.py
+over simulated flights and simulated gusty pad noise, plus any pad pressure
+captured with `uart_reader.py --csv` from a test_measuring_and_printing build. The
+firmware model samples like the given --kind, DECIMATION included unless --reads
+overrides it.
+
+    pipenv run python detector_bench.py --kind throw --pad-csv pad.csv > detectors.csv
+    pipenv run python detector_bench.py --kind throw --reads 1 > detectors-single.csv
+"""
+import csv
+import itertools
+import multiprocessing
+import os
+import statistics
+import sys
+
+import click
+
+from flight_sim import (SETTLE_SECS, LaunchDetector, cdiv, committed, flight_pressure_fn, pad_pressure_fn,
+                        run_firmware, seeded_rng, simulate_flight)
+from log_format import PROFILES
+from telemetry import TYPE_PRESSURE
+
+
+class PairDetector:
+    """What main.cpp did before launch_detector: one pair of samples against a threshold"""
+
+    def __init__(self, pa_interval, threshold_intervals):
+        self.pa_interval = pa_interval
+        self.threshold = threshold_intervals
+        self.last = 0
+
+    def reset(self, baseline_pa):
+        self.last = baseline_pa
+
+    def track(self, pressure_pa):
+        self.last = pressure_pa
+
+    def update(self, pressure_pa):
+        rose = cdiv(self.last - pressure_pa, self.pa_interval) >= self.threshold
+        self.last = pressure_pa
+        return rose
+
+    def quiet(self):
+        return True
+
+
+def load_pad_csv(fn):
+    """Pressure frames from a uart_reader.py --csv capture as (secs, pa) from the first"""
+    samples = []
+    with open(fn) as f:
+        for row in csv.DictReader(f):
+            if int(row['type']) == TYPE_PRESSURE:
+                samples.append((float(row['timestamp']), int(row['fields'])))
+    t0 = samples[0][0]
+    return [(t - t0, pa) for t, pa in samples]
+
+
+def recorded_pad_fn(samples):
+    """Replay a capture, holding each reading until the next one. The noise is already real."""
+    i = 0
+
+    def pressure_at(t, noise_pa=None):
+        nonlocal i
+        i = 0 if t < samples[i][0] else i
+        while i + 1 < len(samples) and samples[i + 1][0] <= t:
+            i += 1
+        return samples[i][1]
+
+    return pressure_at
+
+
+# Populated in each worker by init_worker
+flights_ = None
+pads_ = None
+profile_ = None
+kind_ = None
+reads_ = None
+
+
+def init_worker(flights, pads, profile, kind, reads):
+    global flights_, pads_, profile_, kind_, reads_
+    flights_, pads_, profile_, kind_, reads_ = flights, pads, profile, kind, reads
+
+
+def make_detector(spec):
+    kind, a, b = spec
+    if kind == 'cusum':
+        return LaunchDetector(a, b)
+    return PairDetector(a, b)
+
+
+def evaluate(spec):
+    latencies = []
+    misses = early = 0
+    for i, flight in enumerate(flights_):
+        rng = seeded_rng('bench-flight', i)
+        run = run_firmware(flight_pressure_fn(flight, rng), flight.end_t + SETTLE_SECS, profile_,
+                           make_detector(spec), kind=kind_, reads=reads_)
+        if run.trigger_t is None:
+            misses += 1
+            continue
+        assert committed(run), f"flight {i} didn't commit within SETTLE_SECS"
+        if run.trigger_t < flight.launch_t:
+            early += 1
+        else:
+            latencies.append(run.trigger_t - flight.launch_t)
+
+    triggers = 0
+    observed_secs = 0
+    for i, (fn_args, secs) in enumerate(pads_):
+        pressure_at = recorded_pad_fn(fn_args) if fn_args else pad_pressure_fn(seeded_rng('bench-pad', i))
+        # Keep going after a false trigger so long recordings count every one
+        t0 = 0
+        while t0 < secs:
+            run = run_firmware(lambda t, *a: pressure_at(t0 + t, *a), secs - t0, profile_,
+                               make_detector(spec), kind=kind_, reads=reads_)
+            if run.trigger_t is None:
+                break
+            triggers += 1
+            t0 += run.trigger_t
+        observed_secs += secs
+
+    n = len(flights_)
+    return {
+        'detector': spec[0],
+        'drift_pa' if spec[0] == 'cusum' else 'pa_interval': spec[1],
+        'threshold': spec[2],
+        'median_latency_s': statistics.median(latencies) if latencies else None,
+        'p90_latency_s': (statistics.quantiles(latencies, n=10)[-1] if len(latencies) > 1
+                          else (latencies[0] if latencies else None)),
+        'miss_rate': misses / n,
+        'early_rate': early / n,
+        'pad_false_triggers_per_hour': triggers * 3600 / observed_secs,
+    }
+
+
+def int_list(ctx, param, value):
+    return [int(v) for v in value.split(',')]
+
+
+@click.command()
+@click.option('--kind', type=click.Choice(sorted(PROFILES)), default='rocket')
+@click.option('--flights', default=100, help='Number of simulated flights')
+@click.option('--pad-minutes', default=30, help='Length of each simulated pad trace')
+@click.option('--pad-traces', default=8, help='Number of simulated pad traces')
+@click.option('--pad-csv', multiple=True, type=click.Path(exists=True),
+              help='Recorded pad pressure from uart_reader.py --csv, repeatable')
+@click.option('--drift-pa', default='6,10,15,20', callback=int_list)
+@click.option('--threshold-pa', default='20,40,100,150', callback=int_list)
+@click.option('--pair-thresholds', default='1,2,3', callback=int_list,
+              help='START_DELTA_THRESHOLD_INTERVALS values for the old detector')
+@click.option('--reads', type=int,
+              help="Readings averaged per sample off the pad, the mode's DECIMATION by default")
+@click.option('--jobs', default=os.cpu_count(), help='Worker processes')
+def main(kind, flights, pad_minutes, pad_traces, pad_csv, drift_pa, threshold_pa, pair_thresholds,
+         reads, jobs):
+    profile = PROFILES[kind]
+    corpus = [simulate_flight(kind, seeded_rng('bench-sim', i)) for i in range(flights)]
+    pads = [(None, pad_minutes * 60)] * pad_traces
+    for fn in pad_csv:
+        samples = load_pad_csv(fn)
+        pads.append((samples, samples[-1][0]))
+
+    specs = [('cusum', d, h) for d, h in itertools.product(drift_pa, threshold_pa)]
+    specs += [('pair', profile.PA_INTERVAL, h) for h in pair_thresholds]
+    print(f"{len(specs)} detectors x {len(corpus)} flights, {len(pads)} pad traces", file=sys.stderr)
+
+    with multiprocessing.Pool(jobs, init_worker, (corpus, pads, profile, kind, reads)) as pool:
+        results = pool.map(evaluate, specs, chunksize=1)
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(('detector', 'param', 'threshold', 'median_latency_s', 'p90_latency_s',
+                     'miss_rate', 'early_rate', 'pad_false_triggers_per_hour'))
+    for r in results:
+        values = list(r.values())
+        writer.writerow(['%.3g' % v if isinstance(v, float) else v for v in values])
+
+
+if __name__ == '__main__':
+    main()
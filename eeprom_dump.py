@@ -0,0 +1,70 @@
+"""
+Download a flight over USART from a device in dump mode (hold the button for two
+seconds at power on) and write the raw EEPROM contents, the same bytes
+`avrdude -U eeprom:r:-:r` produces, ready for alt_parser.py.
+
+    pipenv run python eeprom_dump.py --port /dev/cu.usbserial-10 $OUTFILENAME
+"""
+import os.path
+import struct
+import sys
+import time
+
+import click
+import serial
+
+from telemetry import crc16
+
+# Must match eeprom_dump.h
+MAGIC = b'ALTD'
+BAUD = 250000
+
+
+def read_exactly(ser, n, deadline):
+    data = bytearray()
+    while len(data) < n:
+        if time.monotonic() > deadline:
+            raise click.ClickException("Timed out waiting for the device")
+        data += ser.read(n - len(data))
+    return bytes(data)
+
+
+def receive_dump(ser, timeout):
+    deadline = time.monotonic() + timeout
+    window = b''
+    while window != MAGIC:
+        window = (window + read_exactly(ser, 1, deadline))[-len(MAGIC):]
+
+    size, = struct.unpack('<H', read_exactly(ser, 2, deadline))
+    data = read_exactly(ser, size, deadline)
+    crc, = struct.unpack('<H', read_exactly(ser, 2, deadline))
+    if crc != crc16(data):
+        raise click.ClickException("CRC mismatch, hold the button again to resend")
+    return data
+
+
+@click.command()
+@click.option('--port', default='/dev/cu.usbserial-10')
+@click.option('--baud', default=BAUD)
+@click.option('--timeout', default=30.0, help='Seconds to wait for the button hold')
+@click.argument('output')
+def main(port, baud, timeout, output):
+    if output != '-' and os.path.exists(output):
+        if not click.confirm(f"{output} exists, overwrite?"):
+            sys.exit(1)
+
+    with serial.Serial(port, baud, timeout=0.1) as ser:
+        ser.reset_input_buffer()
+        click.echo("Hold the button for two seconds...", err=True)
+        data = receive_dump(ser, timeout)
+
+    if output == '-':
+        sys.stdout.buffer.write(data)
+    else:
+        with open(output, 'wb') as f:
+            f.write(data)
+    click.echo(f"Read {len(data)} bytes", err=True)
+
+
+if __name__ == '__main__':
+    main()
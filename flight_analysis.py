@@ -0,0 +1,165 @@
+"""
+Smoothed altitude, velocity and acceleration for decoded flights, with uncertainty bands,
+and the peak velocity and burnout time they give. Each sample gets a least squares
+polynomial fit over the samples around it, centred on it so nothing lags: Savitzky-Golay,
+but on the sample times themselves since the log slows down partway through. The bands
+come from each fit's residuals, never less than the recorder's rounding to PA_INTERVAL.
+
+Runs over a flight archive, a directory of dumps or a .zip or .tar of them in parallel,
+printing one row per flight, and can write each flight's smoothed series:
+
+    pipenv run python flight_analysis.py flights.alta > analysis.csv
+    pipenv run python flight_analysis.py --kind rocket --series season-smoothed/ season/
+"""
+import csv
+import multiprocessing
+import os
+import sys
+from collections import namedtuple
+
+import click
+import numpy as np
+
+from batch_parser import CHUNK_FILES, dump_profile, list_dumps, read_dump
+from flight_archive import Archive, entry_profile
+from log_format import PROFILES, feet_per_interval, parse_data, split_log
+
+# Samples either side of each one in its fit, and the fit's order. A cubic follows the
+# jerk at burnout that a quadratic would smear out, and wider windows shave the peak
+# velocity off simulated rockets faster than they cut the noise.
+HALF_WINDOW = 3
+ORDER = 3
+# Fewer than this and there's no velocity to speak of
+MIN_SAMPLES = 2
+
+# Each a per-sample array, sigmas one standard deviation
+Smoothed = namedtuple('Smoothed', ('time', 'altitude', 'altitude_sigma', 'velocity', 'velocity_sigma',
+                                   'acceleration', 'acceleration_sigma'))
+
+Analysis = namedtuple('Analysis', ('peak_velocity_ft_s', 'peak_velocity_sigma', 'burnout_s',
+                                   'burnout_sigma', 'apogee_ft', 'apogee_s'))
+
+
+def smooth(time, altitude, interval_ft, half_window=HALF_WINDOW, order=ORDER):
+    """Smoothed series for altitudes in feet at times in seconds, recorded to the nearest
+    interval_ft. All the fits are solved together."""
+    t = np.asarray(time, float)
+    y = np.asarray(altitude, float)
+    n = len(t)
+    width = min(2 * half_window + 1, n)
+    order = min(order, width - 1)
+
+    # Each sample's window, slid inwards at the ends so every fit has width samples
+    start = np.clip(np.arange(n) - half_window, 0, n - width)
+    window = start[:, None] + np.arange(width)
+    x = (t[window] - t[:, None])[..., None] ** np.arange(order + 1)
+    xt = x.transpose(0, 2, 1)
+    normal_inv = np.linalg.inv(xt @ x)
+    coef = (normal_inv @ (xt @ y[window][..., None]))[..., 0]
+
+    # Rounding to an interval alone leaves interval²/12 of variance
+    dof = width - order - 1
+    residual = y[window] - (x @ coef[..., None])[..., 0]
+    variance = (residual ** 2).sum(axis=1) / dof if dof > 0 else np.zeros(n)
+    variance = np.maximum(variance, interval_ft ** 2 / 12)
+    sigma = np.sqrt(variance[:, None] * np.diagonal(normal_inv, axis1=1, axis2=2))
+
+    zeros = np.zeros(n)
+    column = lambda a, i: a[:, i] if i < a.shape[1] else zeros
+    return Smoothed(t, column(coef, 0), column(sigma, 0), column(coef, 1), column(sigma, 1),
+                    2 * column(coef, 2), 2 * column(sigma, 2))
+
+
+def analyze(s):
+    """Peak velocity on the way up, burnout where acceleration falls through zero on the
+    way to it, and apogee, with standard deviations for the first two. A flight whose
+    log starts after burnout, like a throw, gets the peak's time with no sigma."""
+    apogee = int(np.argmax(s.altitude))
+    peak = int(np.argmax(s.velocity[:apogee + 1]))
+    burnout, burnout_sigma = s.time[peak], np.nan
+    # Interpolate the first crossing before apogee, with its time uncertainty from the
+    # acceleration's over how fast it was changing
+    a = s.acceleration
+    crossings = np.flatnonzero((a[:apogee] > 0) & (a[1:apogee + 1] <= 0))
+    if len(crossings):
+        i = crossings[0]
+        jerk = (a[i + 1] - a[i]) / (s.time[i + 1] - s.time[i])
+        burnout = s.time[i] - a[i] / jerk
+        burnout_sigma = max(s.acceleration_sigma[i], s.acceleration_sigma[i + 1]) / -jerk
+    return Analysis(s.velocity[peak], s.velocity_sigma[peak], burnout, burnout_sigma,
+                    s.altitude[apogee], s.time[apogee])
+
+
+def write_series(s, csv_fn):
+    os.makedirs(os.path.dirname(csv_fn) or '.', exist_ok=True)
+    with open(csv_fn, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(('time (secs)', 'altitude (ft)', 'altitude sigma (ft)', 'speed (ft/s)',
+                         'speed sigma (ft/s)', 'acceleration (ft/s2)', 'acceleration sigma (ft/s2)'))
+        for row in zip(*s):
+            writer.writerow(['%.3f' % v for v in row])
+
+
+# Populated in each worker by init_worker
+kind_ = None
+series_dir_ = None
+archive_ = None
+
+
+def init_worker(kind, series_dir, archive_fn):
+    global kind_, series_dir_, archive_
+    kind_, series_dir_ = kind, series_dir
+    archive_ = Archive(archive_fn) if archive_fn else None
+
+
+def process(chunk):
+    """Result rows for a chunk of archive IDs or (name, source) dumps, blank for flights
+    with too few samples to fit"""
+    rows = []
+    for item in chunk:
+        if archive_ is not None:
+            entry = archive_.by_id(item)
+            name = '%d %s' % (item, entry['name'].decode())
+            time, altitude, _ = archive_.columns(entry)
+            interval_ft = feet_per_interval(entry_profile(entry))
+        else:
+            name, source = item
+            bytes = read_dump(source)
+            header, _, _ = split_log(bytes)
+            profile, _ = dump_profile(name, source, header, kind_)
+            time, altitude = zip(*parse_data(bytes, profile))
+            interval_ft = feet_per_interval(profile)
+        if len(time) < MIN_SAMPLES + 1:
+            rows.append((name,) + ('',) * len(Analysis._fields))
+            continue
+        s = smooth(time[1:], altitude[1:], interval_ft)
+        if series_dir_ is not None:
+            write_series(s, os.path.join(series_dir_, name.replace(' ', '-') + '.csv'))
+        rows.append((name, *('%.2f' % v for v in analyze(s))))
+    return rows
+
+
+@click.command()
+@click.option('--kind', type=click.Choice(sorted(PROFILES)), default='rocket',
+              help='Mode for dumps without a summary header or .txt')
+@click.option('--series', type=click.Path(file_okay=False),
+              help='Also write each flight\'s smoothed series here')
+@click.option('--jobs', default=os.cpu_count(), help='Worker processes')
+@click.argument('input', type=click.Path(exists=True))
+def main(kind, series, jobs, input):
+    if os.path.isfile(input) and input.endswith('.alta'):
+        items, archive_fn = Archive(input).index['id'].tolist(), input
+    else:
+        items, archive_fn = list_dumps(input), None
+    chunks = [items[i:i + CHUNK_FILES] for i in range(0, len(items), CHUNK_FILES)]
+
+    with multiprocessing.Pool(jobs, init_worker, (kind, series, archive_fn)) as pool:
+        rows = [row for rows in pool.imap(process, chunks) for row in rows]
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(('flight',) + Analysis._fields)
+    writer.writerows(rows)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,251 @@
+"""
+Append-only archive of flights: each flight's raw EEPROM bytes, the profile it was
+decoded with (what alt_parser.py writes to the .txt) and its decoded time, altitude
+and speed columns, with an index of every flight at the end of the file. Opening an
+archive memory-maps it, so looking flights up by ID or summary statistic reads only
+the index and the columns asked for, without decoding anything.
+
+    pipenv run python flight_archive.py add flights.alta data/
+    pipenv run python flight_archive.py query flights.alta --apogee 200,400
+    pipenv run python flight_archive.py show flights.alta 3 > flight-3.csv
+
+Layout, little-endian, every section 8-byte aligned:
+
+    FILE_HEADER
+    for each flight: raw bytes, then time, altitude and speed as float64
+    ...more flights, each add appends after the last trailer...
+    index: one ENTRY per flight in the archive, in ID order
+    TRAILER: where the index starts and how many entries it has
+
+Each add writes a complete new index and trailer after its flights, so the old ones
+become dead space and readers only ever look at the last trailer.
+"""
+import csv
+import os
+import struct
+import sys
+
+import click
+import numpy as np
+
+from batch_parser import dump_profile, is_dump, read_dump, summarize
+from log_format import MODES, PROFILES, Profile, parse_data, split_log
+
+MAGIC = b'ALTA'
+VERSION = 1
+FILE_HEADER = struct.Struct('<4sHH')
+TRAILER_MAGIC = b'ALTI'
+TRAILER = struct.Struct('<QI4s')
+ALIGN = 8
+# Mode in an entry whose flight has no summary header and no --kind
+UNKNOWN_MODE = 0xFF
+
+ENTRY = np.dtype([
+    ('id', '<u4'),
+    ('name', 'S48'),
+    ('mode', 'u1'),
+    ('log_flight', '<i2'),  # Flight number from the header, -1 for logs from before blocks
+    *((f, '<u4') for f in Profile._fields),
+    ('raw_offset', '<u8'),
+    ('raw_size', '<u4'),
+    ('n_points', '<u4'),
+    ('time_offset', '<u8'),
+    ('altitude_offset', '<u8'),
+    ('speed_offset', '<u8'),
+    ('apogee_ft', '<f4'),
+    ('max_ascent_ft_s', '<f4'),
+    ('duration_s', '<f4'),
+])
+COLUMN = np.dtype('<f8')
+
+
+def columns(data):
+    """time, altitude and speed arrays, speed as alt_parser.py computes it"""
+    t = np.array([t for t, _ in data], COLUMN)
+    a = np.array([a for _, a in data], COLUMN)
+    speed = (a - np.concatenate(([0], a[:-1]))) / (t - np.concatenate(([-1], t[:-1])))
+    return t, a, speed
+
+
+class Archive:
+    """Read-only view of an archive. index is the memory-mapped ENTRY array."""
+
+    def __init__(self, fn):
+        self.map = np.memmap(fn, np.uint8, 'r')
+        magic, version, _ = FILE_HEADER.unpack_from(self.map)
+        footer, n, trailer_magic = TRAILER.unpack_from(self.map, len(self.map) - TRAILER.size)
+        if magic != MAGIC or trailer_magic != TRAILER_MAGIC:
+            raise ValueError(f"{fn} is not a flight archive")
+        if version != VERSION:
+            raise ValueError(f"{fn} is version {version}, expected {VERSION}")
+        self.index = self.map[footer:footer + n * ENTRY.itemsize].view(ENTRY)
+
+    def __len__(self):
+        return len(self.index)
+
+    def by_id(self, id):
+        i = np.searchsorted(self.index['id'], id)
+        if i == len(self.index) or self.index['id'][i] != id:
+            raise KeyError(id)
+        return self.index[i]
+
+    def select(self, apogee=None, duration=None, mode=None):
+        """Entries with apogee_ft and duration_s in the given (low, high) ranges and in mode"""
+        mask = np.ones(len(self.index), bool)
+        for column, bounds in (('apogee_ft', apogee), ('duration_s', duration)):
+            if bounds is not None:
+                mask &= (self.index[column] >= bounds[0]) & (self.index[column] <= bounds[1])
+        if mode is not None:
+            mask &= self.index['mode'] == MODES.index(mode)
+        return self.index[mask]
+
+    def raw(self, entry):
+        return self.map[entry['raw_offset']:entry['raw_offset'] + entry['raw_size']].tobytes()
+
+    def columns(self, entry):
+        """time, altitude and speed, as views into the archive"""
+        size = int(entry['n_points']) * COLUMN.itemsize
+        return tuple(self.map[entry[c]:entry[c] + size].view(COLUMN)
+                     for c in ('time_offset', 'altitude_offset', 'speed_offset'))
+
+
+def entry_mode(entry):
+    return MODES[entry['mode']] if entry['mode'] < len(MODES) else None
+
+
+def entry_profile(entry):
+    return Profile(*(int(entry[f]) for f in Profile._fields))
+
+
+def _pad(f):
+    f.write(b'\0' * (-f.tell() % ALIGN))
+
+
+def append(fn, flights):
+    """Add (name, raw bytes, profile, mode) flights to fn, creating it if need be.
+    Returns their IDs."""
+    if os.path.exists(fn):
+        archive = Archive(fn)
+        index = np.array(archive.index)
+        del archive
+    else:
+        with open(fn, 'wb') as f:
+            f.write(FILE_HEADER.pack(MAGIC, VERSION, 0))
+        index = np.zeros(0, ENTRY)
+
+    entries = np.zeros(len(flights), ENTRY)
+    first_id = int(index['id'][-1]) + 1 if len(index) else 0
+    with open(fn, 'ab') as f:
+        for entry, (name, raw, profile, mode) in zip(entries, flights):
+            data = parse_data(raw, profile)
+            _, log_flight, _ = split_log(raw)
+            apogee, ascent, duration = summarize(data)
+
+            entry['name'] = name.encode()[-ENTRY['name'].itemsize:]
+            entry['mode'] = UNKNOWN_MODE if mode is None else MODES.index(mode)
+            entry['log_flight'] = -1 if log_flight is None else log_flight
+            for field, value in zip(Profile._fields, profile):
+                entry[field] = value
+            entry['apogee_ft'], entry['max_ascent_ft_s'], entry['duration_s'] = apogee, ascent, duration
+
+            _pad(f)
+            entry['raw_offset'], entry['raw_size'] = f.tell(), len(raw)
+            f.write(raw)
+            entry['n_points'] = len(data)
+            for column, values in zip(('time_offset', 'altitude_offset', 'speed_offset'), columns(data)):
+                _pad(f)
+                entry[column] = f.tell()
+                f.write(values.tobytes())
+
+        entries['id'] = np.arange(first_id, first_id + len(flights))
+        index = np.concatenate((index, entries))
+        _pad(f)
+        footer = f.tell()
+        f.write(index.tobytes())
+        f.write(TRAILER.pack(footer, len(index), TRAILER_MAGIC))
+        f.flush()
+        os.fsync(f.fileno())
+    return entries['id'].tolist()
+
+
+def load_flight(path, kind):
+    """(name, raw bytes, profile, mode) for a dump. The profile is the one alt_parser.py
+    wrote next to it if there is one, then the mode in its header, then kind."""
+    raw = read_dump(path)
+    header, _, _ = split_log(raw)
+    profile, mode = dump_profile(path, path, header, kind)
+    return os.path.basename(path), raw, profile, mode
+
+
+def range_option(ctx, param, value):
+    return None if value is None else tuple(float(v) for v in value.split(','))
+
+
+@click.group()
+def main():
+    pass
+
+
+@main.command()
+@click.option('--kind', type=click.Choice(sorted(PROFILES)),
+              help='Mode for dumps without a summary header or .txt')
+@click.argument('archive', type=click.Path(dir_okay=False))
+@click.argument('inputs', nargs=-1, required=True, type=click.Path(exists=True))
+def add(kind, archive, inputs):
+    """Append dumps, or every dump in directories, to ARCHIVE"""
+    paths = []
+    for path in inputs:
+        if os.path.isdir(path):
+            paths += sorted(os.path.join(path, f) for f in os.listdir(path)
+                            if is_dump(f) and os.path.isfile(os.path.join(path, f)))
+        else:
+            paths.append(path)
+    ids = append(archive, [load_flight(p, kind) for p in paths])
+    for path, id in zip(paths, ids):
+        print(f"{id} {path}", file=sys.stderr)
+
+
+@main.command()
+@click.option('--id', 'ids', type=int, multiple=True)
+@click.option('--apogee', callback=range_option, help='low,high in feet')
+@click.option('--duration', callback=range_option, help='low,high in seconds')
+@click.option('--mode', type=click.Choice(MODES))
+@click.argument('archive', type=click.Path(exists=True, dir_okay=False))
+def query(ids, apogee, duration, mode, archive):
+    """Print the index entries of matching flights as CSV"""
+    a = Archive(archive)
+    entries = a.select(apogee, duration, mode)
+    if ids:
+        entries = entries[np.isin(entries['id'], ids)]
+    writer = csv.writer(sys.stdout)
+    writer.writerow(('id', 'name', 'mode', 'flight', 'points', 'apogee_ft', 'max_ascent_ft_s',
+                     'duration_s', *Profile._fields))
+    for e in entries:
+        writer.writerow((e['id'], e['name'].decode(), entry_mode(e) or '',
+                         '' if e['log_flight'] < 0 else e['log_flight'], e['n_points'],
+                         round(float(e['apogee_ft'])), round(float(e['max_ascent_ft_s'])),
+                         round(float(e['duration_s']), 2), *entry_profile(e)))
+
+
+@main.command()
+@click.option('--raw', is_flag=True, help='Write the raw EEPROM bytes instead')
+@click.argument('archive', type=click.Path(exists=True, dir_okay=False))
+@click.argument('id', type=int)
+def show(raw, archive, id):
+    """Print flight ID as alt_parser.py's CSV"""
+    a = Archive(archive)
+    try:
+        entry = a.by_id(id)
+    except KeyError:
+        raise click.ClickException(f"No flight {id} in {archive}")
+    if raw:
+        sys.stdout.buffer.write(a.raw(entry))
+        return
+    writer = csv.writer(sys.stdout)
+    writer.writerow(('time (secs)', 'altitude (ft)', 'speed (ft/s)'))
+    for t, alt, s in zip(*a.columns(entry)):
+        writer.writerow((t.item(), round(alt), round(s)))
+
+
+if __name__ == '__main__':
+    main()
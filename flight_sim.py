@@ -0,0 +1,534 @@
+"""
+Host model of the firmware's sampling loop and recorder. Drives main.cpp's
+state machine and recorder.cpp's nibble encoder with a pressure trace so that
+profiles can be evaluated without hardware. Keep this in step with the firmware.
+"""
+import math
+import random
+from collections import deque, namedtuple
+
+from log_format import (COMMIT_MARKER_HIGH, COMMIT_MARKER_LOW, DECIMATION, EEPROM_SIZE,
+                        FILTER_ACCEL_PA, LOG_ANCHOR, LOG_BLOCK_SIZE, LOG_FLIGHT_OFFSET, LOG_HEADER,
+                        LOG_MAGIC, LOG_PADDING, LOG_RECORDING, LOG_STOPPED, MAX_POSITIVE_VALUE,
+                        MIN_NEGATIVE_VALUE, MODES, PA_PER_FOOT, RECORDER_EEPROM_SIZE, RTC_HZ,
+                        block_checksum, split_log)
+
+GROUND_PRESSURE_PA = 101325
+# BME280 RMS noise at 8x pressure oversampling and filter coefficient 2
+SENSOR_NOISE_PA = 1.5
+# And at 1x with no filter, BME280_PRECISION_ARMED
+ARMED_NOISE_PA = 3.3
+
+# Must match main.cpp
+ARMED_INTERVAL_RTC = RTC_HZ // 2
+ARMED_ESCALATE_PA = 12
+ALERT_TIMEOUT_RTC = RTC_HZ * 2
+PRELAUNCH_SAMPLES = 6
+SUMMARY_INTERVAL_RECORDS = 16
+
+
+def cdiv(a, b):
+    """C integer division, truncating toward zero"""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b >= 0) else -q
+
+
+def int8(v):
+    return (v + 128) % 256 - 128
+
+
+def int16(v):
+    return (v + 32768) % 65536 - 32768
+
+
+def to_nibble(val):
+    return (val - MIN_NEGATIVE_VALUE) & 0x0f
+
+
+class Recorder:
+    """recorder.cpp. eeprom is what the last flight left behind, erased by default, and
+    size its RECORDER_EEPROM_SIZE."""
+    def __init__(self, eeprom=None, size=RECORDER_EEPROM_SIZE):
+        self.eeprom = bytearray(eeprom or b'\xff' * EEPROM_SIZE)
+        self.size = size
+        self.curr_addr = LOG_HEADER.size
+        self.block_end = LOG_HEADER.size + LOG_BLOCK_SIZE - 1
+        self.curr_val = 0
+        self.sum = 0
+        self.flight = 0
+        self.block = 0
+        self.partial_byte = False
+        self.altitude = 0
+        self.n_records = 0
+
+    def write_block_byte(self, val):
+        self.eeprom[self.curr_addr] = val
+        self.curr_addr += 1
+        self.sum = (self.sum + val) & 0xFF
+
+    def room(self):
+        return (self.block_end - self.curr_addr) * 2 - self.partial_byte
+
+    def write_tail(self):
+        marker = self.room() >= 2
+        if self.partial_byte:
+            tail = [self.curr_val | (COMMIT_MARKER_LOW if marker else LOG_PADDING) << 4]
+            if marker:
+                tail.append(COMMIT_MARKER_HIGH | LOG_PADDING << 4)
+        else:
+            tail = [COMMIT_MARKER_LOW | COMMIT_MARKER_HIGH << 4] if marker else []
+        self.eeprom[self.curr_addr:self.curr_addr + len(tail)] = bytes(tail)
+        return block_checksum([self.sum] + tail, self.block, self.flight)
+
+    def next_block(self, nibbles):
+        self.eeprom[self.block_end] = self.write_tail()
+        start = self.block_end + 1
+        end = start + LOG_BLOCK_SIZE - 1 if start + LOG_BLOCK_SIZE <= self.size else self.size - 1
+        if end - start <= LOG_ANCHOR.size or (end - start - LOG_ANCHOR.size) * 2 < nibbles:
+            return False
+        self.curr_addr, self.block_end = start, end
+        self.partial_byte = False
+        self.sum = 0
+        self.block += 1
+        for b in LOG_ANCHOR.pack(self.altitude, self.n_records):
+            self.write_block_byte(b)
+        return True
+
+    def record_one(self, val):
+        nibble = to_nibble(val)
+        if not self.partial_byte:
+            self.curr_val = nibble
+            self.partial_byte = True
+        else:
+            self.curr_val |= nibble << 4
+            self.partial_byte = False
+            self.write_block_byte(self.curr_val)
+
+    def record(self, val):
+        nibbles = 1 + (val // MAX_POSITIVE_VALUE if val > 0 else cdiv(val, MIN_NEGATIVE_VALUE))
+        if nibbles > self.room() and not self.next_block(nibbles):
+            return False
+        self.altitude += val
+        self.n_records += 1
+        if val > 0:
+            while val >= MAX_POSITIVE_VALUE:
+                self.record_one(MAX_POSITIVE_VALUE)
+                val -= MAX_POSITIVE_VALUE
+        else:
+            while val <= MIN_NEGATIVE_VALUE:
+                self.record_one(MIN_NEGATIVE_VALUE)
+                val -= MIN_NEGATIVE_VALUE
+        self.record_one(val)
+        return True
+
+    def commit(self):
+        self.eeprom[self.block_end] = self.write_tail()
+
+    def begin(self):
+        self.eeprom[0] = 0xFF
+        self.flight = (self.eeprom[LOG_FLIGHT_OFFSET] + 1) & 0xFF
+        self.eeprom[LOG_FLIGHT_OFFSET] = self.flight
+        return self.flight
+
+    def write_header(self, *fields):
+        self.eeprom[:LOG_HEADER.size] = LOG_HEADER.pack(LOG_MAGIC, *fields)
+
+
+# Must match flight_phase.h
+BOOST, COAST, APOGEE, DESCENT, LANDED = range(5)
+
+
+class AltitudeFilter:
+    """altitude_filter.cpp, a Kalman filter with 1/256 Pa state and 1/16 Pa² covariance"""
+    FRAC_BITS = 8
+    COVARIANCE_FRAC_BITS = 4
+    MEASUREMENT_VARIANCE = 36
+    VELOCITY_GAIN_BITS = 12
+
+    def __init__(self, accel_pa):
+        self.accel_variance = accel_pa * accel_pa << self.COVARIANCE_FRAC_BITS
+        self.altitude = self.velocity = 0
+        self.p00 = self.MEASUREMENT_VARIANCE
+        self.p01 = 0
+        self.p11 = self.accel_variance
+
+    @classmethod
+    def velocity_gain(cls, p01, s):
+        """(p01 << VELOCITY_GAIN_BITS) // s saturated to 16 bits with the firmware's 32 bit
+        divide, shifting s down with p01 when p01 is too big to shift up"""
+        if p01 >> (16 - cls.VELOCITY_GAIN_BITS) >= s:
+            return 0xFFFF
+        while p01 >> (32 - cls.VELOCITY_GAIN_BITS):
+            p01 >>= 1
+            s >>= 1
+        return min((p01 << cls.VELOCITY_GAIN_BITS) // s, 0xFFFF)
+
+    def update(self, altitude_pa, elapsed_rtc):
+        def mul_rtc(x):
+            return x * elapsed_rtc >> 13
+
+        self.altitude += mul_rtc(self.velocity)
+        q11 = mul_rtc(mul_rtc(self.accel_variance))
+        q01 = mul_rtc(q11) >> 1
+        q00 = mul_rtc(q01) >> 1
+        p11_dt = mul_rtc(self.p11)
+        self.p00 += 2 * mul_rtc(self.p01) + mul_rtc(p11_dt) + q00
+        self.p01 += p11_dt + q01
+        self.p11 += q11
+
+        s = self.p00 + self.MEASUREMENT_VARIANCE
+        k0 = min(65536 - (self.MEASUREMENT_VARIANCE << 16) // s, 0xFFFF)
+        k1 = self.velocity_gain(self.p01, s)
+        residual = (altitude_pa << self.FRAC_BITS) - self.altitude
+        self.altitude += residual * k0 >> 16
+        self.velocity += residual * k1 >> self.VELOCITY_GAIN_BITS
+        self.p11 -= self.p01 * k1 >> self.VELOCITY_GAIN_BITS
+        self.p01 -= self.p01 * k0 >> 16
+        self.p00 -= self.p00 * k0 >> 16
+
+
+class FlightPhase:
+    """flight_phase.cpp"""
+    APOGEE_HYSTERESIS_PA = 10
+    LANDED_SPEED_PA = 20
+    LANDED_BAND_PA = 20
+    LANDED_RTC = RTC_HZ * 5
+    LANDED_FRACTION_SHIFT = 2
+
+    def __init__(self):
+        self.phase = BOOST
+        self.max_altitude = self.still_altitude = self.peak_velocity = 0
+        self.elapsed_rtc = self.apogee_rtc = self.still_rtc = 0
+
+    def update(self, altitude, velocity, elapsed_rtc):
+        self.elapsed_rtc += elapsed_rtc
+        if altitude > self.max_altitude:
+            self.max_altitude = altitude
+            self.apogee_rtc = self.elapsed_rtc
+
+        if self.phase == BOOST:
+            if velocity > self.peak_velocity:
+                self.peak_velocity = velocity
+            elif velocity < self.peak_velocity:
+                self.phase = COAST
+        if self.phase in (BOOST, COAST):
+            if velocity < 0 and altitude <= self.max_altitude - self.APOGEE_HYSTERESIS_PA:
+                self.phase = APOGEE
+        elif self.phase in (APOGEE, DESCENT):
+            self.phase = DESCENT
+            if (abs(velocity) > self.LANDED_SPEED_PA or
+                    abs(altitude - self.still_altitude) > self.LANDED_BAND_PA):
+                self.still_altitude = altitude
+                self.still_rtc = 0
+            else:
+                self.still_rtc += elapsed_rtc
+                if (self.still_rtc >= self.LANDED_RTC and
+                        altitude <= self.max_altitude >> self.LANDED_FRACTION_SHIFT):
+                    self.phase = LANDED
+        return self.phase
+
+    def duration_rtc(self):
+        return self.elapsed_rtc - self.still_rtc if self.phase == LANDED else self.elapsed_rtc
+
+
+# How long to keep the firmware running past a flight's end_t: long enough to sit still
+# for LANDED_RTC and commit, with a few slow samples to spare. Any shorter and the log
+# can be cut off before its last block is checked.
+SETTLE_SECS = FlightPhase.LANDED_RTC / RTC_HZ + 5
+
+
+def rtc_to_ds(rtc):
+    return min(rtc * 10 // RTC_HZ, 0xFFFF)
+
+
+class LaunchDetector:
+    """launch_detector.cpp, a CUSUM in 1/16 Pa fixed point"""
+    FRAC_BITS = 4
+    EMA_SHIFT = 3
+
+    def __init__(self, drift_pa, threshold_pa):
+        self.drift = drift_pa << self.FRAC_BITS
+        self.threshold = threshold_pa << self.FRAC_BITS
+        self.baseline = 0
+        self.sum = 0
+
+    def reset(self, baseline_pa):
+        self.baseline = baseline_pa << self.FRAC_BITS
+        self.sum = 0
+
+    def track(self, pressure_pa):
+        p = pressure_pa << self.FRAC_BITS
+        self.baseline += (p - self.baseline) >> self.EMA_SHIFT
+
+    def update(self, pressure_pa):
+        p = pressure_pa << self.FRAC_BITS
+        self.sum += self.baseline - p - self.drift
+        if self.sum <= 0:
+            self.sum = 0
+            self.baseline += (p - self.baseline) >> self.EMA_SHIFT
+        return self.sum >= self.threshold
+
+    def quiet(self):
+        return self.sum == 0
+
+
+# trigger_t is the time of the tick that detected launch, start_t the time of the
+# launch pressure sample, which the decoder puts at 0, and end_t the time of the last
+# sample that made it into EEPROM. All are None if the run never triggered.
+FirmwareRun = namedtuple('FirmwareRun', ('eeprom', 'trigger_t', 'start_t', 'end_t'))
+
+
+def committed(run):
+    """Whether run landed or filled EEPROM and committed its log, as every triggered run
+    scored against a whole flight should"""
+    header, _, _ = split_log(run.eeprom)
+    return header is not None and header.state == LOG_STOPPED
+
+
+def run_firmware(pressure_at, duration_secs, profile, detector=None, kind='rocket', eeprom=None,
+                 reads=None):
+    """main.cpp's loop, sampling pressure_at(t) until EEPROM fills or duration ends.
+    detector defaults to the profile's LaunchDetector, kind is the mode the header records
+    and eeprom what the Recorder starts with. reads is the readings averaged per sample
+    off the pad, kind's DECIMATION by default."""
+    recorder = Recorder(eeprom)
+    if detector is None:
+        detector = LaunchDetector(profile.CUSUM_DRIFT_PA, profile.CUSUM_THRESHOLD_PA)
+    if reads is None:
+        reads = DECIMATION[kind]
+    # set_tick_interval's, to a whole number of reads
+    fast_rtc = profile.FAST_INTERVAL_RTC // reads * reads
+    slow_rtc = profile.SLOW_INTERVAL_RTC // reads * reads
+
+    armed_secs = ARMED_INTERVAL_RTC / RTC_HZ
+    alert_ticks_max = ALERT_TIMEOUT_RTC // profile.FAST_INTERVAL_RTC
+
+    last_pressure_pa = pressure_at(0, ARMED_NOISE_PA)
+    detector.reset(last_pressure_pa)
+    start_pressure_pa = 0
+    start_rtc = 0
+    last_altitude_intervals = 0
+    n_records = 0
+    running = False
+    alert = False
+    alert_ticks = 0
+    trigger_t = start_t = None
+    phase = FlightPhase()
+    altitude_filter = None
+    prelaunch = deque(maxlen=PRELAUNCH_SAMPLES)  # (t, pressure_pa)
+
+    def sample(t):
+        """The decimator's rounded average of the reads ending at t"""
+        read_secs = interval / reads
+        total = sum(pressure_at(t - i * read_secs) for i in reversed(range(reads)))
+        return (total + reads // 2) // reads
+
+    def record_delta(pressure_pa, elapsed_rtc):
+        nonlocal last_altitude_intervals, n_records
+        altitude_pa = start_pressure_pa - pressure_pa
+        altitude_filter.update(altitude_pa, elapsed_rtc)
+        delta_from_launch = int16(cdiv(altitude_pa, profile.PA_INTERVAL))
+        delta = int8(delta_from_launch - last_altitude_intervals)
+        if not recorder.record(delta):
+            return False
+        last_altitude_intervals += delta
+        n_records += 1
+        return True
+
+    def write_summary(state):
+        recorder.write_header(MODES.index(kind), phase.phase, state, recorder.flight, n_records,
+                              int16(cdiv(phase.max_altitude, profile.PA_INTERVAL)),
+                              rtc_to_ds(phase.apogee_rtc),
+                              rtc_to_ds(phase.duration_rtc()), start_rtc)
+
+    def finish():
+        recorder.commit()
+        write_summary(LOG_STOPPED)
+        return FirmwareRun(bytes(recorder.eeprom), trigger_t, start_t, t)
+
+    t = 0
+    interval = armed_secs
+    interval_rtc = ARMED_INTERVAL_RTC
+    while t + interval <= duration_secs:
+        t += interval
+
+        if running:
+            pressure_pa = sample(t)
+            more = record_delta(pressure_pa, interval_rtc)
+            last_phase = phase.phase
+            filtered = (altitude_filter.altitude >> AltitudeFilter.FRAC_BITS,
+                        int16(altitude_filter.velocity >> AltitudeFilter.FRAC_BITS))
+            if phase.update(*filtered, interval_rtc) == LANDED or not more:
+                return finish()
+            if phase.phase != last_phase or n_records % SUMMARY_INTERVAL_RECORDS == 0:
+                write_summary(LOG_RECORDING)
+            if n_records == profile.FAST_INTERVAL_RECORDS:
+                interval_rtc = slow_rtc
+                interval = interval_rtc / RTC_HZ
+        elif not alert:
+            pressure_pa = pressure_at(t, ARMED_NOISE_PA)
+            if last_pressure_pa - pressure_pa >= ARMED_ESCALATE_PA:
+                start_pressure_pa = last_pressure_pa
+                start_t = t - interval
+                start_rtc = interval_rtc
+                interval_rtc = fast_rtc
+                interval = interval_rtc / RTC_HZ
+                alert = True
+                alert_ticks = 0
+                prelaunch.clear()
+                prelaunch.append((t, pressure_pa))
+            else:
+                detector.track(pressure_pa)
+            last_pressure_pa = pressure_pa
+        else:
+            pressure_pa = sample(t)
+            if detector.update(pressure_pa):
+                recorder.begin()
+                altitude_filter = AltitudeFilter(FILTER_ACCEL_PA[kind])
+                elapsed_rtc = start_rtc
+                for _, p in prelaunch:
+                    record_delta(p, elapsed_rtc)
+                    elapsed_rtc = interval_rtc
+                record_delta(pressure_pa, interval_rtc)
+                phase = FlightPhase()
+                running = True
+                trigger_t = t
+            else:
+                alert_ticks = alert_ticks + 1 if detector.quiet() else 0
+                if alert_ticks == alert_ticks_max:
+                    interval = armed_secs
+                    interval_rtc = ARMED_INTERVAL_RTC
+                    alert = False
+                    last_pressure_pa = pressure_pa
+                else:
+                    if len(prelaunch) == PRELAUNCH_SAMPLES and start_rtc <= 0xFFFF - interval_rtc:
+                        start_rtc += interval_rtc
+                    prelaunch.append((t, pressure_pa))
+                    last_pressure_pa = pressure_pa
+
+    if not running:
+        return FirmwareRun(bytes(recorder.eeprom), None, None, None)
+    return FirmwareRun(bytes(recorder.eeprom), trigger_t, start_t, t)
+
+
+Flight = namedtuple('Flight', ('name', 'times', 'altitudes_ft', 'launch_t', 'end_t'))
+
+
+def flight_pressure_fn(flight, rng, noise_pa=SENSOR_NOISE_PA):
+    """Sensor readings for a flight, interpolating altitude and adding noise"""
+    times, alts = flight.times, flight.altitudes_ft
+    dt = times[1] - times[0]
+
+    def pressure_at(t, noise_pa=noise_pa):
+        i = min(max(int(t / dt), 0), len(times) - 2)
+        frac = min(max((t - times[i]) / dt, 0), 1)
+        alt = alts[i] + (alts[i + 1] - alts[i]) * frac
+        return int(round(GROUND_PRESSURE_PA - alt * PA_PER_FOOT + rng.gauss(0, noise_pa)))
+
+    return pressure_at
+
+
+def pad_pressure_fn(rng, gusts_per_min=2.0, gust_pa=12.0, noise_pa=SENSOR_NOISE_PA):
+    """Sensor readings sitting on the pad with wind gusts pushing pressure around"""
+    gusts = []
+
+    def pressure_at(t, noise_pa=noise_pa):
+        # Lazily schedule gusts as time advances: (start, duration, amplitude)
+        while not gusts or gusts[-1][0] < t + 10:
+            start = (gusts[-1][0] if gusts else 0) + rng.expovariate(gusts_per_min / 60)
+            gusts.append((start, rng.uniform(0.5, 3), rng.gauss(0, gust_pa)))
+        p = GROUND_PRESSURE_PA + rng.gauss(0, noise_pa)
+        for start, dur, amp in gusts[-20:]:
+            if start <= t < start + dur:
+                p += amp * math.sin(math.pi * (t - start) / dur)
+        return int(round(p))
+
+    return pressure_at
+
+
+def simulate_flight(kind, rng, dt=0.01):
+    """Point-mass altitude trace with a few seconds on the pad before launch"""
+    pad_secs = rng.uniform(2, 10)
+    if kind == 'rocket':
+        burn_secs = rng.uniform(0.8, 2.0)
+        thrust_accel = rng.uniform(150, 400)  # ft/s^2
+        drag_k = rng.uniform(0.0005, 0.002)
+        descent_rate = rng.uniform(12, 25)
+    elif kind == 'throw':
+        burn_secs = 0.15
+        thrust_accel = rng.uniform(200, 400)
+        drag_k = 0.002
+        descent_rate = None  # Ballistic
+    elif kind == 'electric':
+        burn_secs = rng.uniform(30, 90)
+        thrust_accel = None
+        climb_rate = rng.uniform(8, 20)
+        descent_rate = rng.uniform(5, 12)
+    elif kind == 'kite':
+        burn_secs = rng.uniform(60, 240)
+        thrust_accel = None
+        climb_rate = rng.uniform(1, 4)
+        descent_rate = rng.uniform(1, 4)
+    else:
+        raise ValueError(kind)
+
+    times, alts = [], []
+    t, alt, vel = 0.0, 0.0, 0.0
+    launched = landed = False
+    end_t = None
+    while end_t is None or t < end_t + 5:
+        ft = t - pad_secs
+        if ft < 0:
+            pass
+        elif thrust_accel is None:
+            # Powered climb at a steady rate then a steady glide back down
+            vel = climb_rate if ft < burn_secs else -descent_rate
+            if kind == 'kite':
+                vel += 2 * math.sin(ft / 3)
+        else:
+            accel = -32.2 - math.copysign(drag_k * vel * vel, vel)
+            if ft < burn_secs:
+                accel += thrust_accel
+            vel += accel * dt
+            if descent_rate is not None and vel < -descent_rate:
+                vel = -descent_rate
+        if ft >= 0 and not landed:
+            alt += vel * dt
+            launched = launched or alt > 0
+            if launched and alt <= 0:
+                alt, vel, landed, end_t = 0.0, 0.0, True, t
+        times.append(t)
+        alts.append(alt)
+        t += dt
+        if t > 3600:
+            break
+
+    return Flight('sim-%s' % kind, times, alts, pad_secs, end_t or t)
+
+
+def recorded_flight(name, data, pad_secs=5.0, dt=0.05):
+    """Resample a decoded [(t, altitude_ft)] log onto a uniform grid behind a pad period"""
+    times, alts = [], []
+    j = 0
+    t = 0.0
+    end_t = pad_secs + data[-1][0]
+    while t <= end_t + 5:
+        ft = t - pad_secs
+        while j + 1 < len(data) and data[j + 1][0] <= ft:
+            j += 1
+        if ft <= 0:
+            alt = 0.0
+        elif j + 1 < len(data):
+            (t0, a0), (t1, a1) = data[j], data[j + 1]
+            alt = a0 + (a1 - a0) * (ft - t0) / (t1 - t0)
+        else:
+            alt = data[-1][1]
+        times.append(t)
+        alts.append(max(alt, 0.0))
+        t += dt
+    return Flight(name, times, alts, pad_secs, end_t)
+
+
+def seeded_rng(*keys):
+    """Deterministic across processes and runs, unlike hash()"""
+    return random.Random(':'.join(str(k) for k in keys))
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Two-state Kalman filter on altitude and vertical speed, for phase detection that
+// doesn't have to difference quantised altitude. Both are in pascals of pressure drop
+// from launch. Constant speed model, with whatever acceleration it doesn't follow
+// treated as white noise of accel_pa per second squared. The covariance is carried
+// along so the gains follow the tick interval when it slows down. Fixed point, the
+// same dozen multiplies and two divisions every sample. flight_sim.py's
+// AltitudeFilter must stay bit-identical.
+
+// Altitude and speed are in 1/256 Pa and 1/256 Pa per second
+#define ALTITUDE_FILTER_FRAC_BITS 8
+
+void altitude_filter_init(uint16_t accel_pa);
+
+// Feed each sample's pressure drop from launch, elapsed_rtc after the previous one
+void altitude_filter_update(int32_t altitude_pa, uint16_t elapsed_rtc);
+
+int32_t altitude_filter_altitude();
+
+int32_t altitude_filter_velocity();
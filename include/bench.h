@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// Benchmark build (-DBENCH): the real sensor is read and compensated but the flight
+// loop is fed a scripted flight so every run takes the same path. Pair with
+// -DTICK_PROFILER to time it.
+
+// Next pressure reading of the scripted flight
+int32_t bench_pressure();
@@ -2,8 +2,17 @@
 
 #include <bme280.h>
 
+// Oversampling and filtering: coarse and cheap while armed on the pad, full in flight
+enum bme280_precision : uint8_t {
+    BME280_PRECISION_ARMED,  // 1x pressure oversampling, no filter
+    BME280_PRECISION_FLIGHT, // 8x pressure oversampling, filter coefficient 2
+};
+
+// Leaves the sensor at BME280_PRECISION_FLIGHT
 int8_t bme280_init();
 
+int8_t bme280_set_precision(bme280_precision precision);
+
 int8_t bme280_measure(int32_t *pres);
 
 /***************************************************************************/
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// Main clock manager. We sleep and wait at F_CLK_PER but race through I2C and the
+// compensation math at a higher speed, since finishing sooner costs less than
+// crawling at 312.5khz. Switching speed reprograms everything derived from CLK_PER
+// so the rest of the code doesn't notice: TWI0 and the debug USART keep their bit
+// rates. The sampling tick runs off the RTC so it doesn't care.
+
+enum clock_speed : uint8_t {
+    CLOCK_SLOW, // F_CLK_PER, 20mhz / 64
+    CLOCK_FAST, // 20mhz / 4
+    CLOCK_MAX,  // 20mhz / 2, for bulk transfers
+};
+
+// RTC count rate, the 32khz internal oscillator divided by 4. Keeps running in standby.
+#define RTC_HZ 8192
+
+void clock_init();
+
+void clock_set(clock_speed speed);
+
+clock_speed clock_get();
+
+// log2 of the current CLK_PER over F_CLK_PER
+uint8_t clock_shift();
+
+// _delay_us only knows about F_CPU and needs a constant, this is a busy wait scaled
+// for the current speed
+void clock_delay_us(uint32_t us);
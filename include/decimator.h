@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Boxcar decimator, a first order CIC: sums readings taken at reads times the logging
+// rate and gives their rounded average once every reads of them, so the log only sees
+// the decimated value. Averaging n readings cuts independent noise by √n, so fewer
+// deltas are spent recording noise. The average lags the last reading by half the
+// span of the reads. flight_sim.py's run_firmware must stay bit-identical.
+
+// Also starts a new sum
+void decimator_init(uint8_t reads);
+
+// Returns whether this reading completes a sample, with its average in *average_pa
+bool decimator_add(int32_t pressure_pa, int32_t *average_pa);
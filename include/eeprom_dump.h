@@ -0,0 +1,10 @@
+#pragma once
+
+// Stream the whole EEPROM over USART so a flight can be pulled off with just a
+// USB serial adapter instead of a UPDI programmer. eeprom_dump.py is the host side.
+//
+//   "ALTD" | size (2, LE) | EEPROM contents | crc (2, CRC-16/MCRF4XX of contents, LE)
+
+#define EEPROM_DUMP_BAUD 250000
+
+void eeprom_dump();
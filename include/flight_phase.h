@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Online flight phase tracking from the filtered altitude and speed (altitude_filter.h),
+// for stopping once we're back on the ground and summarising the flight. Altitudes
+// are in pascals of pressure drop from launch, speeds in pascals per second and times
+// in RTC counts since launch detection.
+
+enum flight_phase : uint8_t {
+    FLIGHT_PHASE_BOOST,   // Climbing faster each sample
+    FLIGHT_PHASE_COAST,   // Still climbing, slowing down
+    FLIGHT_PHASE_APOGEE,  // The sample that confirmed we're past the top
+    FLIGHT_PHASE_DESCENT, // Coming down
+    FLIGHT_PHASE_LANDED,  // Stopped moving low down
+};
+
+void flight_phase_init();
+
+// Feed each sample's filtered altitude and speed along with how long since the previous one
+flight_phase flight_phase_update(int32_t altitude_pa, int16_t velocity_pa, uint16_t elapsed_rtc);
+
+int32_t flight_phase_max_altitude_pa();
+
+uint32_t flight_phase_apogee_rtc();
+
+// Time since launch detection, up to touchdown rather than when we noticed once landed
+uint32_t flight_phase_duration_rtc();
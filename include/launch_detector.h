@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// One-sided CUSUM on pressure falling below a slowly tracking baseline. Each sample
+// adds how far it sits below the baseline, less drift_pa, to a running sum clamped
+// at zero; launch is when the sum reaches threshold_pa. Noise and gusts that come
+// back up drain away instead of building up, and a steady climb trips it however
+// it's split across samples. The baseline only follows pressure while the sum is
+// zero so a slow climb can't drag it along. Constant time and space per sample.
+// flight_sim.py's LaunchDetector must stay bit-identical.
+
+void launch_detector_init(uint8_t drift_pa, uint16_t threshold_pa);
+
+void launch_detector_reset(int32_t baseline_pa);
+
+// Follow pressure on the pad without looking for launch, for the armed state's
+// coarse samples
+void launch_detector_track(int32_t pressure_pa);
+
+// Returns whether this sample completes a launch
+bool launch_detector_update(int32_t pressure_pa);
+
+// Whether the sum is back to zero, i.e. nothing looks like a launch in progress
+bool launch_detector_quiet();
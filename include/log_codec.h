@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+// The EEPROM log format, in one place for recorder.cpp and the host tools:
+// log_format.py reads the #defines and structs here rather than keeping copies, so
+// keep constants to #defines of integer expressions and structs to stdint fields.
+//
+// Each record is the change in altitude since the one before in PA_INTERVALs, one
+// nibble, low half of each byte first. A nibble holds the value less
+// MIN_NEGATIVE_VALUE, and the two ends of the range are escapes that carry into the
+// next nibble, so a big change takes an escape per MAX_POSITIVE_VALUE or
+// MIN_NEGATIVE_VALUE ahead of the remainder.
+
+// We expect to go up faster than down so allocate more bits to
+// the positive side of the range
+#define MAX_POSITIVE_VALUE 10
+#define MIN_NEGATIVE_VALUE (MAX_POSITIVE_VALUE - 15)
+
+// Escapes only ever carry in their own direction, so a minimum escape is never
+// followed by a maximum one and the pair can mark the end of the log
+#define COMMIT_MARKER_LOW 0x0
+#define COMMIT_MARKER_HIGH 0xF
+// An escape with nothing after it, which the decoder discards
+#define LOG_PADDING 0xF
+
+// Flight summary at the start of EEPROM, ahead of the log. It's kept current through
+// the flight so the LED readout and a dump can get apogee from it alone, and so most
+// of it survives losing power.
+#define LOG_MAGIC 0xA3
+#define LOG_RECORDING 0xFF // log_header.state while recording, or if power was lost
+#define LOG_STOPPED 0x00   // Landed or EEPROM full
+
+struct log_header {
+    uint8_t magic;  // LOG_MAGIC once the first summary is written, erased before that
+    uint8_t mode;   // flight_profile mode the flight was recorded with
+    uint8_t phase;  // Latest flight_phase
+    uint8_t state;  // LOG_RECORDING or LOG_STOPPED
+    uint8_t flight; // Counts launches, written at launch detection ahead of the rest
+    uint16_t n_records;
+    int16_t max_altitude_intervals;
+    uint16_t apogee_ds; // Launch detection to apogee, tenths of a second
+    uint16_t duration_ds;
+    // RTC counts from the launch pressure sample, which the log's altitudes are from,
+    // to the first record. That sample is from before going on alert so it's further
+    // back than the fast interval the rest are at.
+    uint16_t start_rtc;
+};
+
+// The log after the header is split into LOG_BLOCK_SIZE byte blocks, the last one cut
+// short by the end of EEPROM, so a corrupt or torn byte only loses its own block:
+//
+//   log_anchor (not in the first block) | nibbles | checksum (1)
+//
+// The anchor is where the block starts from, so each block decodes on its own. A
+// record never straddles two blocks and a commit marker or escape padding ends any
+// block that isn't full. The checksum is the complement of the 8 bit sum of the
+// flight number, the block's index and its bytes up to the end of the nibbles,
+// so blocks left over from an earlier flight don't check out. Two blocks for
+// 5 bytes of overhead in 128 bytes of EEPROM.
+#define LOG_BLOCK_SIZE 58
+
+struct log_anchor {
+    int16_t altitude_intervals;
+    uint8_t n_records; // Records before this block
+};
+
+constexpr uint8_t log_nibble(int8_t val) { return (val - MIN_NEGATIVE_VALUE) & 0x0f; }
+
+constexpr int8_t log_value(uint8_t nibble) { return nibble + MIN_NEGATIVE_VALUE; }
+
+// One nibble for the value and one for each escape ahead of it
+constexpr uint8_t log_record_nibbles(int8_t val) {
+    return 1 + (val > 0 ? val / MAX_POSITIVE_VALUE : val / MIN_NEGATIVE_VALUE);
+}
+
+constexpr uint8_t log_checksum(uint8_t sum, uint8_t flight, uint8_t block) {
+    return ~(uint8_t)(sum + flight + block);
+}
+
+static_assert(log_nibble(MIN_NEGATIVE_VALUE) == COMMIT_MARKER_LOW, "Marker isn't a minimum escape");
+static_assert(log_nibble(MAX_POSITIVE_VALUE) == COMMIT_MARKER_HIGH, "Marker isn't a maximum escape");
+static_assert(log_nibble(MAX_POSITIVE_VALUE) == LOG_PADDING, "Padding isn't an escape");
+static_assert(log_value(log_nibble(-3)) == -3, "Nibbles don't round trip");
+static_assert(log_record_nibbles(INT8_MAX) == 13 && log_record_nibbles(INT8_MIN) == 26,
+              "Escape counts are off");
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Which profile flies, kept in the USERROW so it survives both power cycles and
+// reflashing and the log can use all of EEPROM. The log header records it too, so the
+// decoder doesn't need telling.
+
+// The stored mode, or DEFAULT_MODE if none has been chosen. Benchmark builds always
+// get DEFAULT_MODE.
+uint8_t mode_store_load();
+
+// Only rewrites the USERROW if mode changed
+void mode_store_save(uint8_t mode);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "clock.h"
+
+// Sampling profiles, one for each kind of flight. All of them are built in and the
+// flight loop is instantiated for each, so every profile's constants fold into its own
+// code; which one flies is picked at boot. log_format.py reads this file for PROFILES,
+// so keep to #define lines and one designated initializer per profile.
+
+// This is not really linear but should be close enough to only introduce
+// a few percent error assuming we're launching from near sea level, only
+// going ~1000ft and operating around ambient temperature
+
+#define MODE_ROCKET 0
+#define MODE_THROW 1
+#define MODE_ELECTRIC 2
+#define MODE_KITE 3
+#define N_MODES 4
+
+#ifndef DEFAULT_MODE // Benchmark builds pick the mode with a build flag
+#define DEFAULT_MODE MODE_ROCKET
+#endif
+
+struct flight_profile {
+    uint8_t mode;                   // MODE_ROCKET and so on, recorded in the log header
+    uint8_t pa_interval;            // Pressure per recorded step
+    uint16_t fast_interval_rtc;     // Sample interval for the first fast_interval_records
+    uint16_t slow_interval_rtc;     // And after
+    uint16_t fast_interval_records;
+    uint8_t cusum_drift_pa;         // Launch detection, see launch_detector.h
+    uint16_t cusum_threshold_pa;
+    uint8_t filter_accel_pa;        // Altitude filter process noise, see altitude_filter.h
+    uint8_t decimation;             // Readings averaged per logged sample, see decimator.h
+};
+
+constexpr flight_profile ROCKET_PROFILE = {
+    .mode = MODE_ROCKET,
+    .pa_interval = 18, // 5 feet interval
+    .fast_interval_rtc = RTC_HZ / 8,
+    .slow_interval_rtc = RTC_HZ,
+    .fast_interval_records = 80,
+    .cusum_drift_pa = 10,
+    .cusum_threshold_pa = 100,
+    .filter_accel_pa = 25,
+    .decimation = 1,
+};
+
+constexpr flight_profile THROW_PROFILE = {
+    .mode = MODE_THROW,
+    .pa_interval = 5, // ~1.5'
+    .fast_interval_rtc = RTC_HZ / 10,
+    .slow_interval_rtc = RTC_HZ,
+    .fast_interval_records = 200,
+    .cusum_drift_pa = 15,
+    .cusum_threshold_pa = 100,
+    .filter_accel_pa = 25,
+    .decimation = 3,
+};
+
+constexpr flight_profile ELECTRIC_PROFILE = {
+    .mode = MODE_ELECTRIC,
+    .pa_interval = 17, // ~5'
+    .fast_interval_rtc = RTC_HZ / 4,
+    .slow_interval_rtc = RTC_HZ,
+    .fast_interval_records = 40,
+    .cusum_drift_pa = 15,
+    .cusum_threshold_pa = 40,
+    .filter_accel_pa = 25,
+    .decimation = 1,
+};
+
+constexpr flight_profile KITE_PROFILE = {
+    .mode = MODE_KITE,
+    .pa_interval = 11, // ~3'
+    .fast_interval_rtc = RTC_HZ / 2,
+    .slow_interval_rtc = RTC_HZ,
+    .fast_interval_records = 256,
+    .cusum_drift_pa = 15,
+    .cusum_threshold_pa = 40,
+    .filter_accel_pa = 10,
+    .decimation = 1,
+};
+
+// Indexed by mode, for code that only needs a profile's constants now and then
+constexpr const flight_profile *PROFILES[N_MODES] = {
+    &ROCKET_PROFILE,
+    &THROW_PROFILE,
+    &ELECTRIC_PROFILE,
+    &KITE_PROFILE,
+};
+static_assert(PROFILES[MODE_ROCKET]->mode == MODE_ROCKET && PROFILES[MODE_THROW]->mode == MODE_THROW &&
+                  PROFILES[MODE_ELECTRIC]->mode == MODE_ELECTRIC && PROFILES[MODE_KITE]->mode == MODE_KITE,
+              "PROFILES out of order");
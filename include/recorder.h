@@ -2,5 +2,29 @@
 
 #include <stdint.h>
 
+#include "log_codec.h"
+#include "tick_profiler.h"
+
+// The log ends here, leaving the tick profiler's stats at the top of EEPROM when it
+// saves them
+#define RECORDER_EEPROM_SIZE (EEPROM_SIZE - TICK_PROFILER_EEPROM_SIZE)
+
+// Call at launch detection: invalidates the last flight's summary and returns the
+// new flight number
+uint8_t recorder_begin();
+
+// Returns false if there was no room left for the record
 bool recorder_record(int8_t val);
 bool recorder_record_test_byte(int8_t val);
+
+// Write out a pending half byte, a commit marker that tells the decoder where the log
+// ends and the checksum of the block so far. Recording can carry on afterwards,
+// overwriting both, so this is safe to call from the brownout interrupt whenever the
+// supply sags.
+void recorder_commit();
+
+// Only the bytes that changed since the last call cost an EEPROM write
+void recorder_write_header(const log_header *header);
+
+// Returns whether there's a valid summary, from this flight or the last one
+bool recorder_read_header(log_header *header);
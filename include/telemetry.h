@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tick_profiler.h"
+
+// Live telemetry over the debug USART. Each message is
+//
+//   type (1) | seq (1) | body | crc (2, CRC-16/MCRF4XX of type, seq and body, LE)
+//
+// COBS encoded and terminated by a zero byte, so a receiver can resync at any
+// frame boundary. seq increments on every message, including ones dropped
+// because the transmit buffer was full, so the receiver can count losses.
+// Multi-byte fields are little-endian. telemetry.py is the host side.
+
+enum telemetry_type : uint8_t {
+    TELEMETRY_TYPE_PRESSURE = 1, // int32 pascals
+    TELEMETRY_TYPE_DELTA = 2,    // int8 intervals recorded
+    TELEMETRY_TYPE_STATE = 3,    // telemetry_state_body
+    TELEMETRY_TYPE_TIMING = 4,   // telemetry_timing_body
+    TELEMETRY_TYPE_PHASE = 5,    // uint8 flight_phase
+    TELEMETRY_TYPE_FILTER = 6,   // telemetry_filter_body
+};
+
+enum telemetry_flight_state : uint8_t {
+    TELEMETRY_STATE_PAD,       // Armed, sampling slowly until pressure starts falling
+    TELEMETRY_STATE_RECORDING, // Launch detected
+    TELEMETRY_STATE_DONE,      // EEPROM full, recording stopped
+    TELEMETRY_STATE_ALERT,     // Pressure falling on the pad, sampling at full rate
+};
+
+struct telemetry_state_body {
+    uint8_t state; // telemetry_flight_state
+    uint16_t n_records;
+};
+
+// altitude_filter.h's state, in 1/256 Pa and 1/256 Pa per second
+struct telemetry_filter_body {
+    int32_t altitude;
+    int32_t velocity;
+};
+
+// One tick profiler phase, in F_CLK_PER cycles
+struct telemetry_timing_body {
+    uint8_t phase;
+    uint16_t count;
+    uint16_t min;
+    uint16_t avg;
+    uint16_t max;
+    uint8_t buckets[TICK_PROFILER_N_BUCKETS];
+};
+
+#define TELEMETRY_MAX_BODY sizeof(telemetry_timing_body)
+
+#ifdef USART_DEBUG
+#define TELEMETRY_PRESSURE(pa) telemetry_pressure(pa)
+#define TELEMETRY_DELTA(delta) telemetry_delta(delta)
+#define TELEMETRY_STATE(state, n_records) telemetry_state(state, n_records)
+#define TELEMETRY_PHASE(phase) telemetry_phase(phase)
+#define TELEMETRY_FILTER(altitude, velocity) telemetry_filter(altitude, velocity)
+#else
+#define TELEMETRY_PRESSURE(pa)
+#define TELEMETRY_DELTA(delta)
+#define TELEMETRY_STATE(state, n_records)
+#define TELEMETRY_PHASE(phase)
+#define TELEMETRY_FILTER(altitude, velocity)
+#endif
+
+// Frame and queue a message without blocking. Returns false if it was dropped.
+bool telemetry_send(telemetry_type type, const void *body, uint8_t len);
+
+void telemetry_pressure(int32_t pa);
+
+void telemetry_delta(int8_t delta);
+
+void telemetry_state(telemetry_flight_state state, uint16_t n_records);
+
+void telemetry_phase(uint8_t phase);
+
+void telemetry_filter(int32_t altitude, int32_t velocity);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+// Instrumentation mode (-DTICK_PROFILER): timestamps the phases of each tick against a
+// free-running CLK_PER counter and keeps per-phase min/max/sum and a coarse histogram
+// in RAM. Times are in F_CLK_PER cycles (3.2us) whatever speed the clock manager
+// ran the phase at. At the end of a flight the stats are sent as telemetry and, with
+// -DTICK_PROFILER_EEPROM, saved to a reserved area at the top of EEPROM.
+
+enum tick_phase : uint8_t {
+    TICK_PHASE_WAKE,         // Timer overflow until the loop runs again
+    TICK_PHASE_TRIGGER,      // Start a forced conversion
+    TICK_PHASE_CONVERSION,   // Wait for the conversion to finish
+    TICK_PHASE_I2C_READ,     // Read the raw data registers
+    TICK_PHASE_COMPENSATION, // Raw readings to pascals
+    TICK_PHASE_DELTA,        // Delta from launch, or launch detection on the pad
+    TICK_PHASE_ENCODE,       // Recorder nibble encoding
+    TICK_PHASE_EEPROM_WRITE, // Starting the EEPROM write of a full byte
+    TICK_N_PHASES,
+};
+
+#define TICK_PROFILER_N_BUCKETS 8
+
+// What gets saved to EEPROM for each phase, in F_CLK_PER cycles
+struct tick_profiler_summary {
+    uint16_t min;
+    uint16_t max;
+    uint16_t avg;
+};
+
+#ifdef TICK_PROFILER
+#define TICK_PROFILER_INIT() tick_profiler_init()
+#define TICK_PROFILER_START() tick_profiler_start()
+#define TICK_PROFILER_MARK(phase) tick_profiler_mark(phase)
+#define TICK_PROFILER_END() tick_profiler_end()
+#define TICK_PROFILER_DUMP() tick_profiler_dump()
+#define TICK_PROFILER_CLOCK_CHANGE() tick_profiler_clock_change()
+#else
+#define TICK_PROFILER_INIT()
+#define TICK_PROFILER_START()
+#define TICK_PROFILER_MARK(phase)
+#define TICK_PROFILER_END()
+#define TICK_PROFILER_DUMP()
+#define TICK_PROFILER_CLOCK_CHANGE()
+#endif
+
+// A summary for each phase, spelled out so log_format.py can read it
+#define TICK_PROFILER_STATS_SIZE 48
+static_assert(TICK_PROFILER_STATS_SIZE == TICK_N_PHASES * sizeof(tick_profiler_summary),
+              "TICK_PROFILER_STATS_SIZE out of date");
+
+#if defined(TICK_PROFILER) && defined(TICK_PROFILER_EEPROM)
+#define TICK_PROFILER_EEPROM_SIZE TICK_PROFILER_STATS_SIZE
+#else
+#define TICK_PROFILER_EEPROM_SIZE 0
+#endif
+
+void tick_profiler_init();
+
+// Call on wake, before any mark
+void tick_profiler_start();
+
+// Attribute the cycles since the last start or mark to phase
+void tick_profiler_mark(tick_phase phase);
+
+// Call just before the clock speed changes
+void tick_profiler_clock_change();
+
+// Fold this tick's per-phase totals into the stats
+void tick_profiler_end();
+
+void tick_profiler_dump();
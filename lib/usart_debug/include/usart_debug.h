@@ -5,21 +5,41 @@
 #ifdef USART_DEBUG
 #define USART_DEBUG_INIT() usart_debug_init()
 #define USART_DEBUG_SEND(c) usart_debug_send(c)
+#define USART_DEBUG_FLUSH() usart_debug_flush()
+#define USART_DEBUG_DRAIN() usart_debug_drain()
+#define USART_DEBUG_BUSY() usart_debug_busy()
 #else
 #define USART_DEBUG_INIT()
 #define USART_DEBUG_SEND(c)
+#define USART_DEBUG_FLUSH()
+#define USART_DEBUG_DRAIN()
+#define USART_DEBUG_BUSY() false
 #endif
 
-void usart_debug_init() {
-    PORTMUX.USARTROUTEA |= PORTMUX_USART1_ALT1_gc;
-    VPORTC.DIR |= PIN2_bm; // TxD on PC2
-    USART1.BAUD = (uint16_t)((float)(F_CLK_PER * 64 / (16 * (float)9600)) + 0.5);
-    USART1.CTRLB = USART_TXEN_bm; // TX only
-}
-
-void usart_debug_send(char byte) {
-    while (!(USART1.STATUS & USART_DREIF_bm)) {
-        ;
-    }
-    USART1_TXDATAL = byte;
-}
+// Must be a power of two
+#define USART_DEBUG_BUFFER_SIZE 32
+
+void usart_debug_init();
+
+// Queue a byte for the data register empty interrupt to send. Never blocks: if
+// the buffer is full the byte is dropped and counted instead.
+void usart_debug_send(char byte);
+
+// Queue all of buf or, if there isn't room for all of it, none of it so that a
+// frame is never cut short. Returns whether it was queued.
+bool usart_debug_send_all(const uint8_t *buf, uint8_t len);
+
+// Wait until everything queued has been handed to the USART. Polls the USART itself
+// when interrupts are off.
+void usart_debug_flush();
+
+// Flush and then wait for the last byte to leave the shift register, for before
+// anything that changes the bit rate
+void usart_debug_drain();
+
+// Whether anything is queued or still on the wire, in which case the USART needs
+// its clock and we can't go into standby
+bool usart_debug_busy();
+
+// Bytes dropped because the buffer was full
+uint16_t usart_debug_overflows();
@@ -0,0 +1,99 @@
+#include "usart_debug.h"
+
+#include "avr/interrupt.h"
+
+#define BUFFER_MASK (USART_DEBUG_BUFFER_SIZE - 1)
+
+static char buffer_[USART_DEBUG_BUFFER_SIZE];
+static volatile uint8_t head_, tail_;
+static volatile uint16_t overflows_;
+static volatile bool sent_; // Whether TXCIF will eventually be set
+
+void usart_debug_init() {
+    PORTMUX.USARTROUTEA |= PORTMUX_USART1_ALT1_gc;
+    VPORTC.DIR |= PIN2_bm; // TxD on PC2
+    USART1.BAUD = (uint16_t)((float)(F_CLK_PER * 64 / (16 * (float)9600)) + 0.5);
+    USART1.CTRLB = USART_TXEN_bm; // TX only
+}
+
+static bool enqueue(char byte) {
+    uint8_t next = (head_ + 1) & BUFFER_MASK;
+    if (next == tail_) {
+        return false;
+    }
+    buffer_[head_] = byte;
+    head_ = next;
+    // The ISR turns this back off once the buffer drains
+    USART1.CTRLA = USART_DREIE_bm;
+    return true;
+}
+
+void usart_debug_send(char byte) {
+    if (!enqueue(byte) && overflows_ < UINT16_MAX) {
+        overflows_++;
+    }
+}
+
+bool usart_debug_send_all(const uint8_t *buf, uint8_t len) {
+    uint8_t free = (tail_ - head_ - 1) & BUFFER_MASK;
+    if (len > free) {
+        if (overflows_ < UINT16_MAX) {
+            overflows_++;
+        }
+        return false;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        enqueue(buf[i]);
+    }
+    return true;
+}
+
+// Hand the next queued byte to the USART, or turn the interrupt off once there are none
+static void send_next() {
+    uint8_t tail = tail_;
+    if (tail == head_) {
+        USART1.CTRLA = 0;
+        return;
+    }
+    USART1.STATUS = USART_TXCIF_bm;
+    USART1.TXDATAL = buffer_[tail];
+    sent_ = true;
+    tail_ = (tail + 1) & BUFFER_MASK;
+}
+
+void usart_debug_flush() {
+    while (head_ != tail_) {
+        // With interrupts off (e.g. dumping EEPROM after wait_for_button's cli()) the ISR
+        // never runs, so feed the data register from here
+        if (!(SREG & CPU_I_bm) && (USART1.STATUS & USART_DREIF_bm)) {
+            send_next();
+        }
+    }
+}
+
+void usart_debug_drain() {
+    usart_debug_flush();
+    if (sent_) {
+        while (!(USART1.STATUS & USART_TXCIF_bm)) {
+            ;
+        }
+        sent_ = false;
+    }
+}
+
+bool usart_debug_busy() {
+    if (head_ != tail_) {
+        return true;
+    }
+    if (sent_ && !(USART1.STATUS & USART_TXCIF_bm)) {
+        return true;
+    }
+    sent_ = false;
+    return false;
+}
+
+uint16_t usart_debug_overflows() { return overflows_; }
+
+ISR(USART1_DRE_vect) {
+    send_next();
+}
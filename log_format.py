@@ -0,0 +1,496 @@
+import struct
+from collections import namedtuple
+
+from c_header import defines, struct_instances, struct_layout
+
+try:
+    import numpy as np
+except ImportError:  # decode_nibbles_batch falls back on the scalar decoder
+    np = None
+
+# The format and profiles come straight from the firmware's headers
+_CLOCK = defines('clock.h')
+_CODEC = defines('log_codec.h')
+_MODES = defines('profiles.h', _CLOCK)
+
+MAX_POSITIVE_VALUE = _CODEC['MAX_POSITIVE_VALUE']
+MIN_NEGATIVE_VALUE = _CODEC['MIN_NEGATIVE_VALUE']
+COMMIT_MARKER_LOW = _CODEC['COMMIT_MARKER_LOW']
+COMMIT_MARKER_HIGH = _CODEC['COMMIT_MARKER_HIGH']
+LOG_PADDING = _CODEC['LOG_PADDING']
+# The ATtiny826's
+EEPROM_SIZE = 128
+# Where the log ends. Dumps from -DTICK_PROFILER -DTICK_PROFILER_EEPROM builds have the
+# profiler's stats above PROFILED_RECORDER_EEPROM_SIZE, so decode them with that.
+_TICK_PROFILER = defines('tick_profiler.h')
+RECORDER_EEPROM_SIZE = defines('recorder.h', {'EEPROM_SIZE': EEPROM_SIZE, 'TICK_PROFILER_EEPROM_SIZE': 0})[
+    'RECORDER_EEPROM_SIZE']
+PROFILED_RECORDER_EEPROM_SIZE = defines('recorder.h', {
+    'EEPROM_SIZE': EEPROM_SIZE,
+    'TICK_PROFILER_EEPROM_SIZE': _TICK_PROFILER['TICK_PROFILER_STATS_SIZE'],
+})['RECORDER_EEPROM_SIZE']
+# The unit of the interval constants
+RTC_HZ = _CLOCK['RTC_HZ']
+
+LOG_MAGIC = _CODEC['LOG_MAGIC']
+LOG_RECORDING = _CODEC['LOG_RECORDING']
+LOG_STOPPED = _CODEC['LOG_STOPPED']
+LOG_HEADER, _header_fields = struct_layout('log_codec.h', 'log_header')
+LogHeader = namedtuple('LogHeader', _header_fields)
+# The flight number is written at launch, ahead of the rest of the header
+LOG_FLIGHT_OFFSET = struct.calcsize(LOG_HEADER.format[:1 + _header_fields.index('flight')])
+
+LOG_BLOCK_SIZE = _CODEC['LOG_BLOCK_SIZE']
+LOG_ANCHOR, _ = struct_layout('log_codec.h', 'log_anchor')
+
+# Must match flight_phase in flight_phase.h
+FLIGHT_PHASES = ('boost', 'coast', 'apogee', 'descent', 'landed')
+
+# Feet of altitude per pascal of pressure drop near sea level
+PA_PER_FOOT = 3.6
+
+# The decoding end of flight_profile, whose fields are these lower-cased
+Profile = namedtuple('Profile', (
+    'PA_INTERVAL',
+    'FAST_INTERVAL_RTC',
+    'SLOW_INTERVAL_RTC',
+    'FAST_INTERVAL_RECORDS',
+    'CUSUM_DRIFT_PA',
+    'CUSUM_THRESHOLD_PA',
+))
+
+# MODE_ROCKET and so on, in mode order
+_modes = sorted((v, k) for k, v in _MODES.items() if k.startswith('MODE_'))
+MODES = tuple(k[len('MODE_'):].lower() for _, k in _modes)
+
+# Every flight_profile in profiles.h, by mode name
+_PROFILES = {MODES[p['mode']]: p for p in struct_instances('profiles.h', 'flight_profile', _CLOCK).values()}
+
+PROFILES = {mode: Profile(*(_PROFILES[mode][f.lower()] for f in Profile._fields)) for mode in MODES}
+
+# Process noise of the altitude filter and readings per sample in each mode, which
+# decoding doesn't need
+FILTER_ACCEL_PA = {mode: _PROFILES[mode]['filter_accel_pa'] for mode in MODES}
+DECIMATION = {mode: _PROFILES[mode]['decimation'] for mode in MODES}
+
+
+def fast_interval_secs(profile):
+    return profile.FAST_INTERVAL_RTC / RTC_HZ
+
+
+def slow_interval_secs(profile):
+    return profile.SLOW_INTERVAL_RTC / RTC_HZ
+
+
+def feet_per_interval(profile):
+    return profile.PA_INTERVAL / PA_PER_FOOT
+
+
+def read_profile_txt(txt_fn):
+    """Read the profile parameters alt_parser.py wrote next to a flight"""
+    values = {}
+    for line in open(txt_fn):
+        if '=' in line:
+            k, v = line.strip().split('=', 1)
+            values[k] = v
+    if 'FAST_INTERVAL_RTC' not in values:
+        # Flights from before the RTC tick gave intervals in (inverse) seconds
+        values['FAST_INTERVAL_RTC'] = RTC_HZ // int(values['FAST_INTERVAL_INVERSE_SECS'])
+        values['SLOW_INTERVAL_RTC'] = RTC_HZ * int(values['SLOW_INTERVAL_SECS'])
+    return Profile(
+        int(values['PA_INTERVAL']),
+        int(values['FAST_INTERVAL_RTC']),
+        int(values['SLOW_INTERVAL_RTC']),
+        int(values['FAST_INTERVAL_RECORDS']),
+        # Launch detection doesn't affect decoding
+        int(values.get('CUSUM_DRIFT_PA', 0)),
+        int(values.get('CUSUM_THRESHOLD_PA', 0)),
+    )
+
+
+def split_log(bytes):
+    """The summary header, or None if power was lost before the first one or the log
+    predates headers, the flight number that seeds the block checksums, None for logs
+    from before blocks, and the log after the header"""
+    head = bytes[:LOG_HEADER.size]
+    if len(head) == LOG_HEADER.size and head[0] == LOG_MAGIC:
+        header = LogHeader(*LOG_HEADER.unpack(head))
+        return header, header.flight, bytes[LOG_HEADER.size:]
+    if len(head) == LOG_HEADER.size and head[0] == 0xFF:
+        return None, head[LOG_FLIGHT_OFFSET], bytes[LOG_HEADER.size:]
+    # Logs from before the header start right at the beginning, one run of nibbles
+    return None, None, bytes
+
+
+def header_mode(header):
+    return MODES[header.mode] if header.mode < len(MODES) else None
+
+
+def describe_header(header, profile):
+    phase = FLIGHT_PHASES[header.phase] if header.phase < len(FLIGHT_PHASES) else header.phase
+    stopped = 'stopped' if header.state == LOG_STOPPED else 'lost power'
+    unverified = '' if header.state == LOG_STOPPED else ', any records past the last checksum unverified'
+    return (f"{header_mode(header) or header.mode} flight, "
+            f"max altitude {header.max_altitude_intervals * feet_per_interval(profile):.0f}ft, "
+            f"apogee at {header.apogee_ds / 10}s, duration {header.duration_ds / 10}s, "
+            f"{header.n_records} records, {stopped} in {phase}{unverified}")
+
+
+def decode_nibbles(bytes):
+    """Deltas up to a commit marker or the end, and how many bytes that took"""
+    raw_deltas = []
+    for b in bytes:
+        raw_deltas.append((b & 0x0f) + MIN_NEGATIVE_VALUE)
+        raw_deltas.append(((b >> 4) & 0x0f) + MIN_NEGATIVE_VALUE)
+
+    carry = 0
+    deltas = []
+    last_rd = None
+    for i, rd in enumerate(raw_deltas):
+        if last_rd == MIN_NEGATIVE_VALUE and rd == MAX_POSITIVE_VALUE:
+            # Commit marker, anything after it is left over from an earlier flight
+            return deltas, i // 2 + 1
+        last_rd = rd
+        if(rd == MAX_POSITIVE_VALUE or rd == MIN_NEGATIVE_VALUE):
+            carry = carry + rd
+        else:
+            deltas.append(carry + rd)
+            carry = 0
+    return deltas, len(bytes)
+
+
+def decode_nibbles_batch(buffers):
+    """decode_nibbles for each of buffers, all at once with numpy"""
+    if np is None:
+        return [decode_nibbles(b) for b in buffers]
+    n = len(buffers)
+    lengths = np.fromiter((len(b) for b in buffers), np.int64, n)
+    if not lengths.sum():
+        return [([], 0)] * n
+    data = np.frombuffer(b''.join(buffers), np.uint8)
+
+    # Every nibble as a value, and which buffer it came from
+    values = np.empty(2 * len(data), np.int64)
+    values[0::2] = (data & 0x0f).astype(np.int64) + MIN_NEGATIVE_VALUE
+    values[1::2] = (data >> 4).astype(np.int64) + MIN_NEGATIVE_VALUE
+    first = np.concatenate(([0], np.cumsum(2 * lengths)[:-1]))
+    segment = np.repeat(np.arange(n), 2 * lengths)
+
+    # Each buffer stops at the second nibble of its first commit marker
+    ends = 2 * lengths
+    marker = np.flatnonzero((values[:-1] == MIN_NEGATIVE_VALUE) & (values[1:] == MAX_POSITIVE_VALUE) &
+                            (segment[:-1] == segment[1:])) + 1
+    np.minimum.at(ends, segment[marker], marker - first[segment[marker]])
+    consumed = np.where(ends < 2 * lengths, ends // 2 + 1, lengths)
+
+    # Each value that isn't an escape ends a delta, which sums it with the escapes
+    # since the last one in its buffer
+    escape = (values == MAX_POSITIVE_VALUE) | (values == MIN_NEGATIVE_VALUE)
+    ends_at = np.flatnonzero(~escape & (np.arange(len(values)) - first[segment] < ends[segment]))
+    totals = np.concatenate(([0], np.cumsum(values)))
+    owner = segment[ends_at]
+    new_segment = np.concatenate(([True], owner[1:] != owner[:-1]))
+    starts_at = np.where(new_segment, first[owner], np.concatenate(([0], ends_at[:-1] + 1)))
+    deltas = totals[ends_at + 1] - totals[starts_at]
+
+    split = np.searchsorted(owner, np.arange(1, n))
+    return [(d.tolist(), int(c)) for d, c in zip(np.split(deltas, split), consumed)]
+
+
+def record_ends(bytes):
+    """Nibble index just past each delta decode_nibbles would give for bytes"""
+    ends = []
+    last_rd = None
+    for i in range(2 * len(bytes)):
+        rd = (bytes[i // 2] >> (4 * (i % 2)) & 0x0f) + MIN_NEGATIVE_VALUE
+        if last_rd == MIN_NEGATIVE_VALUE and rd == MAX_POSITIVE_VALUE:
+            break
+        last_rd = rd
+        if rd != MAX_POSITIVE_VALUE and rd != MIN_NEGATIVE_VALUE:
+            ends.append(i + 1)
+    return ends
+
+
+def block_checksum(bytes, index, flight):
+    return ~(flight + index + sum(bytes)) & 0xFF
+
+
+def _blocks(log):
+    return [log[i:i + LOG_BLOCK_SIZE] for i in range(0, len(log), LOG_BLOCK_SIZE)]
+
+
+def _nibble_start(index):
+    return 0 if index == 0 else LOG_ANCHOR.size
+
+
+# A decoded block. verified is False for the one a flight was still writing when it
+# stopped, whose checksum was never written.
+Block = namedtuple('Block', ('altitude', 'n_records', 'deltas', 'verified'))
+
+
+def _anchor(block, index):
+    if index == 0:
+        return 0, 0
+    if len(block) > LOG_ANCHOR.size:
+        return LOG_ANCHOR.unpack_from(block)
+    return None
+
+
+def _check_block(block, index, flight, deltas, length):
+    anchor = _anchor(block, index)
+    if anchor is None:
+        return None
+    if block_checksum(block[:_nibble_start(index) + length], index, flight) != block[-1]:
+        return None
+    return Block(*anchor, deltas, True)
+
+
+def _block_end(block):
+    return block.altitude + sum(block.deltas), block.n_records + len(block.deltas)
+
+
+def decode_block(block, index, flight):
+    """Block for one block of the log, starting from its anchor, or None if it fails
+    its checksum"""
+    return _check_block(block, index, flight, *decode_nibbles(block[_nibble_start(index):-1]))
+
+
+def decode_unverified(block, index, end, n_records):
+    """The block a flight that never committed was writing, which starts where the one
+    before it ended (end, or None if it didn't check out), cut at the n_records the
+    summary last recorded. A record ending on a byte's low nibble only reaches EEPROM
+    with the next nibble, so the last one there is left out. None if there's nothing
+    to trust."""
+    anchor = _anchor(block, index)
+    if anchor is None or (end is not None and anchor != end) or anchor[1] >= n_records:
+        return None
+    ends = record_ends(block[_nibble_start(index):-1])[:n_records - anchor[1]]
+    if ends and ends[-1] % 2:
+        ends.pop()
+    if not ends:
+        return None
+    deltas, _ = decode_nibbles(block[_nibble_start(index):_nibble_start(index) + (ends[-1] + 1) // 2])
+    return Block(*anchor, deltas[:len(ends)], False)
+
+
+def decode_blocks(log, flight, nibbles=None, header=None):
+    """decode_block for each block, in order. A block that checks out but doesn't start
+    where the one before it ended is left over from an earlier flight, and so is
+    everything after it. nibbles is decode_nibbles of each block, if already done. If
+    header says the flight was still recording, the block after the last one that
+    checks out is decoded with decode_unverified."""
+    blocks = _blocks(log)
+    if nibbles is None:
+        nibbles = [decode_nibbles(b[_nibble_start(i):-1]) for i, b in enumerate(blocks)]
+    decoded = []
+    end = None
+    for i, (block, (deltas, length)) in enumerate(zip(blocks, nibbles)):
+        block = _check_block(block, i, flight, deltas, length)
+        if block is not None and end is not None and block[:2] != end:
+            decoded += [None] * (len(blocks) - i)
+            break
+        decoded.append(block)
+        end = None if block is None else _block_end(block)
+
+    if header is not None and header.state == LOG_RECORDING:
+        good = [i for i, b in enumerate(decoded) if b is not None]
+        i = good[-1] + 1 if good else 0
+        if i < len(blocks):
+            end = _block_end(decoded[i - 1]) if i else None
+            decoded[i] = decode_unverified(blocks[i], i, end, header.n_records)
+    return decoded
+
+
+def start_secs(header, profile):
+    """Seconds from launch pressure to the first record. Logs without a summary don't
+    say, so take the fast interval as the firmware did before recording it."""
+    return header.start_rtc / RTC_HZ if header is not None else fast_interval_secs(profile)
+
+
+def record_time(n_records, profile, start=None):
+    """Seconds from launch pressure to the n_records'th record, the first start after it"""
+    if start is None:
+        start = fast_interval_secs(profile)
+    if n_records == 0:
+        return 0
+    fast = min(n_records, profile.FAST_INTERVAL_RECORDS) - 1
+    return start + fast * fast_interval_secs(profile) + (n_records - 1 - fast) * slow_interval_secs(profile)
+
+
+def parse_many(logs, profile, size=RECORDER_EEPROM_SIZE):
+    """parse_data for each of logs, decoding all their nibbles in one batch"""
+    splits = [split_log(bytes[:size]) for bytes in logs]
+    regions = []
+    for _, flight, log in splits:
+        if flight is None:
+            regions.append([log])
+        else:
+            regions.append([block[_nibble_start(i):-1] for i, block in enumerate(_blocks(log))])
+    nibbles = iter(decode_nibbles_batch([r for rs in regions for r in rs]))
+
+    ft_per_interval = feet_per_interval(profile)
+    parsed = []
+    for (header, flight, log), rs in zip(splits, regions):
+        start = start_secs(header, profile)
+        block_nibbles = [next(nibbles) for _ in rs]
+        if flight is None:
+            blocks = [Block(0, 0, block_nibbles[0][0], True)]
+        else:
+            blocks = [b for b in decode_blocks(log, flight, block_nibbles, header) if b is not None]
+
+        data = [[0, 0]]
+        for altitude, n_records, deltas, _ in blocks:
+            for d in deltas:
+                altitude += d
+                n_records += 1
+                data.append([record_time(n_records, profile, start), altitude * ft_per_interval])
+        parsed.append(data)
+    return parsed
+
+
+def parse_data(bytes, profile, size=RECORDER_EEPROM_SIZE):
+    """[time, altitude] in seconds and feet for each record. Records in blocks that
+    fail their checksum are left out, the blocks after them still decode. A flight
+    that lost power before committing keeps the records of the block it was writing up
+    to the summary's count; describe_header says they're unverified. Anything past
+    size, where the recorder stops, is ignored."""
+    return parse_many([bytes], profile, size)[0]
+
+
+Sample = namedtuple('Sample', ('time', 'altitude', 'speed'))
+
+
+class StreamDecoder:
+    """parse_data for a log arriving in pieces of any size: feed it bytes as they come
+    and get back the samples they complete, with speed as alt_parser.py computes it.
+    Holds at most one block, since a block's records can only be trusted once its
+    checksum has arrived. Records in logs from before blocks come out as soon as their
+    last nibble does. size is where the recorder stops, which is where the last,
+    shorter block ends; anything after it is ignored."""
+
+    def __init__(self, profile, size=RECORDER_EEPROM_SIZE):
+        self.profile = profile
+        self.ft_per_interval = feet_per_interval(profile)
+        self.size = size
+        self.read = 0
+        self.header = None
+        self.flight = None
+        # None until the first bytes show whether there's a header
+        self.blocks = None
+        self.head = bytearray()
+        self.block = bytearray()
+        self.index = 0
+        # altitude_intervals and n_records where the last good block ended
+        self.end = None
+        # The first block after the last good one, with the end it starts from, for a
+        # flight that lost power before committing
+        self.unverified = None
+        self.done = False
+        self.started = False
+        self.last = (-1, 0)
+        # Logs from before blocks are decoded a nibble at a time
+        self.carry = 0
+        self.last_nibble = None
+        self.altitude = 0
+        self.n_records = 0
+
+    def feed(self, data):
+        samples = self._start()
+        for b in data:
+            if self.done or self.read == self.size:
+                break
+            self.read += 1
+            if self.blocks is None:
+                self.head.append(b)
+                if self.head[0] not in (LOG_MAGIC, 0xFF):
+                    self._without_blocks(samples)
+                elif len(self.head) == LOG_HEADER.size:
+                    self.header, self.flight, _ = split_log(bytes(self.head))
+                    self.blocks = True
+            elif self.blocks:
+                self.block.append(b)
+                if len(self.block) == self._block_size():
+                    self._close_block(samples)
+            else:
+                self._nibbles(b, samples)
+        return samples
+
+    def finish(self):
+        """Samples held back for bytes that never came, from a dump cut short"""
+        samples = self._start()
+        if self.blocks is None:
+            self._without_blocks(samples)
+        elif self.blocks and self.block and not self.done:
+            self._close_block(samples)
+        if self.unverified is not None and self.header.state == LOG_RECORDING:
+            block = decode_unverified(*self.unverified, self.header.n_records)
+            if block is not None:
+                self._block_samples(block, samples)
+        self.unverified = None
+        self.done = True
+        return samples
+
+    def _start(self):
+        if self.started:
+            return []
+        self.started = True
+        return [self._sample(0, 0)]
+
+    def _sample(self, n_records, altitude):
+        t = record_time(n_records, self.profile, start_secs(self.header, self.profile))
+        a = altitude * self.ft_per_interval
+        speed = (a - self.last[1]) / (t - self.last[0])
+        self.last = (t, a)
+        return Sample(t, a, speed)
+
+    def _without_blocks(self, samples):
+        self.blocks = False
+        for b in self.head:
+            self._nibbles(b, samples)
+        self.head.clear()
+
+    def _block_size(self):
+        start = LOG_HEADER.size + self.index * LOG_BLOCK_SIZE
+        return min(LOG_BLOCK_SIZE, max(1, self.size - start))
+
+    def _close_block(self, samples):
+        raw = bytes(self.block)
+        block = decode_block(raw, self.index, self.flight)
+        self.block.clear()
+        self.index += 1
+        if block is None:
+            if self.header is not None and (self.unverified is None or self.end is not None):
+                self.unverified = (raw, self.index - 1, self.end)
+            self.end = None
+            return
+        if self.end is not None and block[:2] != self.end:
+            # Left over from an earlier flight, as in decode_blocks
+            self.done = True
+            return
+        self.unverified = None
+        self._block_samples(block, samples)
+
+    def _block_samples(self, block, samples):
+        altitude, n_records, deltas, _ = block
+        for d in deltas:
+            altitude += d
+            n_records += 1
+            samples.append(self._sample(n_records, altitude))
+        self.end = (altitude, n_records)
+
+    def _nibbles(self, b, samples):
+        for nibble in (b & 0x0f, b >> 4):
+            if self.done:
+                return
+            rd = nibble + MIN_NEGATIVE_VALUE
+            if self.last_nibble == MIN_NEGATIVE_VALUE and rd == MAX_POSITIVE_VALUE:
+                self.done = True
+                return
+            self.last_nibble = rd
+            if rd == MAX_POSITIVE_VALUE or rd == MIN_NEGATIVE_VALUE:
+                self.carry += rd
+            else:
+                self.altitude += self.carry + rd
+                self.carry = 0
+                self.n_records += 1
+                samples.append(self._sample(self.n_records, self.altitude))
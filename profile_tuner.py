@@ -0,0 +1,180 @@
+"""
+Sweep the profile constants from main.cpp over a grid, running the firmware model
+in flight_sim.py against a corpus of simulated and recorded flights, and emit the
+Pareto front of apogee error, flight coverage and false-trigger rate.
+
+    pipenv run python profile_tuner.py --kind rocket --flights 200 > front.csv
+"""
+import csv
+import functools
+import itertools
+import multiprocessing
+import os
+import sys
+import time
+
+import click
+
+from flight_sim import (SETTLE_SECS, committed, flight_pressure_fn, pad_pressure_fn, recorded_flight,
+                        run_firmware, seeded_rng, simulate_flight)
+from log_format import RTC_HZ, Profile, parse_data, read_profile_txt
+
+SLOW_INTERVAL_RTC = RTC_HZ
+
+# Populated in each worker by init_worker
+kind_ = None
+corpus_ = None
+pad_minutes_ = None
+pad_traces_ = None
+seed_ = None
+
+
+def load_recorded_flights(data_dir):
+    flights = []
+    if not data_dir or not os.path.isdir(data_dir):
+        return flights
+    for fn in sorted(os.listdir(data_dir)):
+        path = os.path.join(data_dir, fn)
+        if '.' in fn or not os.path.exists(path + '.txt'):
+            continue
+        profile = read_profile_txt(path + '.txt')
+        data = parse_data(open(path, 'rb').read(), profile)
+        flights.append(recorded_flight('rec-' + fn, data))
+    return flights
+
+
+def init_worker(kind, corpus, pad_minutes, pad_traces, seed):
+    global kind_, corpus_, pad_minutes_, pad_traces_, seed_
+    kind_, corpus_, pad_minutes_, pad_traces_, seed_ = kind, corpus, pad_minutes, pad_traces, seed
+
+
+@functools.lru_cache(maxsize=None)
+def false_triggers_per_hour(fast_interval_rtc, drift_pa, threshold_pa):
+    # Only the pre-launch constants matter here so share the result across the rest of the grid
+    profile = Profile(1, fast_interval_rtc, SLOW_INTERVAL_RTC, 1, drift_pa, threshold_pa)
+    triggers = 0
+    observed_secs = 0
+    for i in range(pad_traces_):
+        rng = seeded_rng(seed_, 'pad', i)
+        run = run_firmware(pad_pressure_fn(rng), pad_minutes_ * 60, profile, kind=kind_)
+        if run.trigger_t is None:
+            observed_secs += pad_minutes_ * 60
+        else:
+            triggers += 1
+            observed_secs += run.trigger_t
+    return triggers * 3600 / observed_secs
+
+
+def evaluate(profile):
+    apogee_errors = []
+    coverages = []
+    early_triggers = 0
+    for i, flight in enumerate(corpus_):
+        rng = seeded_rng(seed_, 'flight', i)
+        run = run_firmware(flight_pressure_fn(flight, rng), flight.end_t + SETTLE_SECS, profile,
+                           kind=kind_)
+        true_apogee = max(flight.altitudes_ft)
+        if run.trigger_t is None:
+            apogee_errors.append(true_apogee)
+            coverages.append(0)
+            continue
+        assert committed(run), f"flight {i} didn't commit within SETTLE_SECS"
+        if run.trigger_t < flight.launch_t:
+            early_triggers += 1
+
+        decoded = parse_data(run.eeprom, profile)
+        apogee_errors.append(abs(max(a for _, a in decoded) - true_apogee))
+
+        flight_secs = flight.end_t - flight.launch_t
+        covered_secs = min(run.end_t, flight.end_t) - max(run.start_t, flight.launch_t)
+        coverages.append(min(max(covered_secs / flight_secs, 0), 1))
+
+    n = len(corpus_)
+    return {
+        'pa_interval': profile.PA_INTERVAL,
+        'fast_interval_rtc': profile.FAST_INTERVAL_RTC,
+        'fast_interval_records': profile.FAST_INTERVAL_RECORDS,
+        'cusum_drift_pa': profile.CUSUM_DRIFT_PA,
+        'cusum_threshold_pa': profile.CUSUM_THRESHOLD_PA,
+        'apogee_error_ft': sum(apogee_errors) / n,
+        'max_apogee_error_ft': max(apogee_errors),
+        'coverage': sum(coverages) / n,
+        'early_trigger_rate': early_triggers / n,
+        'pad_false_triggers_per_hour': false_triggers_per_hour(
+            profile.FAST_INTERVAL_RTC, profile.CUSUM_DRIFT_PA, profile.CUSUM_THRESHOLD_PA),
+    }
+
+
+def objectives(r):
+    # All minimized
+    return (r['apogee_error_ft'], -r['coverage'],
+            r['pad_false_triggers_per_hour'] + r['early_trigger_rate'])
+
+
+def pareto_front(results):
+    scored = [(objectives(r), r) for r in results]
+    front = []
+    for o, r in scored:
+        dominated = any(all(a <= b for a, b in zip(other, o)) and other != o for other, _ in scored)
+        if not dominated:
+            front.append(r)
+    return sorted(front, key=objectives)
+
+
+def int_list(ctx, param, value):
+    return [int(v) for v in value.split(',')]
+
+
+@click.command()
+@click.option('--kind', type=click.Choice(['rocket', 'throw', 'electric', 'kite']), default='rocket')
+@click.option('--flights', default=100, help='Number of simulated flights in the corpus')
+@click.option('--data-dir', default='data', help='Recorded flights to add to the corpus')
+@click.option('--pa-interval', default='5,11,18,25,35', callback=int_list)
+@click.option('--fast-interval-rtc', default='4096,2048,1024,819', callback=int_list,
+              help='Fast sample intervals in RTC counts (8192 per second)')
+@click.option('--fast-interval-records', default='40,80,120,200', callback=int_list)
+@click.option('--cusum-drift-pa', default='6,10,15,20', callback=int_list)
+@click.option('--cusum-threshold-pa', default='20,40,100,150', callback=int_list)
+@click.option('--pad-minutes', default=10, help='Length of each pad noise trace')
+@click.option('--pad-traces', default=12, help='Pad noise traces per pre-launch setting')
+@click.option('--jobs', default=os.cpu_count(), help='Worker processes')
+@click.option('--seed', default=0)
+@click.option('--all-out', type=click.Path(), help='Also write every grid point to this CSV')
+def main(kind, flights, data_dir, pa_interval, fast_interval_rtc, fast_interval_records,
+         cusum_drift_pa, cusum_threshold_pa, pad_minutes, pad_traces, jobs, seed, all_out):
+    corpus = [simulate_flight(kind, seeded_rng(seed, 'sim', i)) for i in range(flights)]
+    if kind == 'rocket':
+        corpus += load_recorded_flights(data_dir)
+
+    grid = [
+        Profile(pa, interval, SLOW_INTERVAL_RTC, records, drift, threshold)
+        for pa, interval, records, drift, threshold in itertools.product(
+            pa_interval, fast_interval_rtc, fast_interval_records, cusum_drift_pa,
+            cusum_threshold_pa)
+    ]
+    print(f"{len(grid)} grid points x {len(corpus)} flights on {jobs} workers", file=sys.stderr)
+
+    # Grid points vary a lot in cost (sample rate, how soon EEPROM fills) so hand them
+    # out one at a time to whichever worker frees up first rather than pre-partitioning.
+    start = time.time()
+    results = []
+    with multiprocessing.Pool(jobs, init_worker, (kind, corpus, pad_minutes, pad_traces, seed)) as pool:
+        for r in pool.imap_unordered(evaluate, grid, chunksize=1):
+            results.append(r)
+            print(f"\r{len(results)}/{len(grid)}", end='', file=sys.stderr)
+    print(f"\ndone in {time.time() - start:.1f}s", file=sys.stderr)
+
+    fields = list(results[0].keys())
+    if all_out:
+        with open(all_out, 'w') as f:
+            writer = csv.DictWriter(f, fields)
+            writer.writeheader()
+            writer.writerows(sorted(results, key=objectives))
+
+    writer = csv.DictWriter(sys.stdout, fields)
+    writer.writeheader()
+    writer.writerows(pareto_front(results))
+
+
+if __name__ == '__main__':
+    main()
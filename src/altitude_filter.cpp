@@ -0,0 +1,79 @@
+#include "altitude_filter.h"
+
+#include "clock.h"
+
+// Covariances are in 1/16 Pa², per second and per second squared. One reading's
+// variance is the BME280's (1.5Pa)² at flight precision.
+#define COVARIANCE_FRAC_BITS 4
+#define MEASUREMENT_VARIANCE 36
+// The speed gain is per second, Q12 so up to 16/s fits in 16 bits
+#define VELOCITY_GAIN_BITS 12
+
+static_assert(RTC_HZ == 1L << 13, "mul_rtc counts on 2^13 RTC counts a second");
+
+static int32_t altitude_, velocity_;
+static uint32_t p00_, p01_, p11_;
+static uint32_t accel_variance_;
+
+// x * k >> shift from two 16 bit multiplies, for shift <= 16 and results that fit
+static inline int32_t mul_shift(int32_t x, uint16_t k, uint8_t shift) {
+    return (x >> 16) * ((int32_t)k << (16 - shift)) + (int32_t)(((uint32_t)(uint16_t)x * k) >> shift);
+}
+
+// x * elapsed_rtc in seconds
+static inline int32_t mul_rtc(int32_t x, uint16_t elapsed_rtc) { return mul_shift(x, elapsed_rtc, 13); }
+
+// (p01 << VELOCITY_GAIN_BITS) / s saturated to 16 bits, with a 32 bit divide. Short of
+// saturating p01 < 16s, so when p01 is too big to shift up, s is big enough to shift down
+// alongside it, losing only low bits of the gain.
+static uint16_t velocity_gain(uint32_t p01, uint32_t s) {
+    if (p01 >> (16 - VELOCITY_GAIN_BITS) >= s) {
+        return UINT16_MAX;
+    }
+    while (p01 >> (32 - VELOCITY_GAIN_BITS)) {
+        p01 >>= 1;
+        s >>= 1;
+    }
+    uint32_t k1 = (p01 << VELOCITY_GAIN_BITS) / s;
+    return k1 > UINT16_MAX ? UINT16_MAX : k1;
+}
+
+void altitude_filter_init(uint16_t accel_pa) {
+    accel_variance_ = (uint32_t)accel_pa * accel_pa << COVARIANCE_FRAC_BITS;
+    altitude_ = velocity_ = 0;
+    // Launch pressure is a reading, and we could be a second's acceleration into the climb
+    p00_ = MEASUREMENT_VARIANCE;
+    p01_ = 0;
+    p11_ = accel_variance_;
+}
+
+void altitude_filter_update(int32_t altitude_pa, uint16_t elapsed_rtc) {
+    // Predict: carry on at the same speed, less sure of both by as much as an
+    // acceleration we don't know about could have moved them in elapsed_rtc
+    altitude_ += mul_rtc(velocity_, elapsed_rtc);
+    uint32_t q11 = mul_rtc(mul_rtc(accel_variance_, elapsed_rtc), elapsed_rtc);
+    uint32_t q01 = mul_rtc(q11, elapsed_rtc) >> 1;
+    uint32_t q00 = mul_rtc(q01, elapsed_rtc) >> 1;
+    uint32_t p11_dt = mul_rtc(p11_, elapsed_rtc);
+    p00_ += 2 * mul_rtc(p01_, elapsed_rtc) + mul_rtc(p11_dt, elapsed_rtc) + q00;
+    p01_ += p11_dt + q01;
+    p11_ += q11;
+
+    // Update: move towards the reading by how much less sure of the prediction we
+    // are than of the sensor. k0 is p00 / (p00 + R) in Q16 without the 48 bit dividend.
+    uint32_t s = p00_ + MEASUREMENT_VARIANCE;
+    uint32_t k0 = 65536 - ((uint32_t)MEASUREMENT_VARIANCE << 16) / s;
+    uint16_t k1 = velocity_gain(p01_, s);
+    k0 = k0 > UINT16_MAX ? UINT16_MAX : k0;
+
+    int32_t residual = (altitude_pa << ALTITUDE_FILTER_FRAC_BITS) - altitude_;
+    altitude_ += mul_shift(residual, k0, 16);
+    velocity_ += mul_shift(residual, k1, VELOCITY_GAIN_BITS);
+    p11_ -= mul_shift(p01_, k1, VELOCITY_GAIN_BITS);
+    p01_ -= mul_shift(p01_, k0, 16);
+    p00_ -= mul_shift(p00_, k0, 16);
+}
+
+int32_t altitude_filter_altitude() { return altitude_; }
+
+int32_t altitude_filter_velocity() { return velocity_; }
@@ -0,0 +1,32 @@
+#ifdef BENCH
+
+#include "bench.h"
+
+#define BENCH_GROUND_PA 101325
+#define BENCH_PAD_TICKS 16
+#define BENCH_BOOST_TICKS 8
+
+static uint16_t tick_;
+static int16_t alt_ft_, vel_ft_per_tick_;
+
+int32_t bench_pressure() {
+    // Sit on the pad, boost, coast to apogee then descend under chute. Units are
+    // per tick rather than per second so the shape is the same for every profile.
+    if (tick_ >= BENCH_PAD_TICKS) {
+        if (tick_ < BENCH_PAD_TICKS + BENCH_BOOST_TICKS) {
+            vel_ft_per_tick_ += 5;
+        } else if (vel_ft_per_tick_ > -3) {
+            vel_ft_per_tick_ -= 4;
+        }
+        alt_ft_ += vel_ft_per_tick_;
+        if (alt_ft_ < 0) {
+            alt_ft_ = 0;
+        }
+    }
+    tick_++;
+
+    // Add a little alternating noise so the pad isn't perfectly still
+    return BENCH_GROUND_PA - (int32_t)alt_ft_ * 36 / 10 + (tick_ & 1);
+}
+
+#endif
@@ -1,14 +1,14 @@
 #include "bme280_client.h"
-
-// Need this define to support variable delay
-#define __DELAY_BACKWARD_COMPATIBLE__
+#include "bench.h"
+#include "clock.h"
+#include "tick_profiler.h"
 
 #include <TinyI2CMaster.h>
 #include <assert.h>
 #include <avr/io.h>
-#include <util/delay.h>
 
 #define F_SCL 100000 // 100khz
+#define BME280_LEN_P_T_DATA 6
 
 uint32_t bme_meas_delay_us_;
 static uint8_t bme_dev_addr_ = BME280_I2C_ADDR_PRIM;
@@ -30,6 +30,10 @@ int8_t bme280_init() {
         return rslt;
     }
 
+    return bme280_set_precision(BME280_PRECISION_FLIGHT);
+};
+
+int8_t bme280_set_precision(bme280_precision precision) {
     struct bme280_settings settings = {
         .osr_p = BME280_OVERSAMPLING_8X,
         .osr_t = BME280_OVERSAMPLING_1X,
@@ -37,14 +41,17 @@ int8_t bme280_init() {
         .filter = BME280_FILTER_COEFF_2,
         .standby_time = 0, // Unused
     };
-    rslt = bme280_set_sensor_settings(BME280_SEL_ALL_SETTINGS, &settings, &bme_dev_);
+    if (precision == BME280_PRECISION_ARMED) {
+        settings.osr_p = BME280_OVERSAMPLING_1X;
+        settings.filter = BME280_FILTER_COEFF_OFF;
+    }
+    int8_t rslt = bme280_set_sensor_settings(BME280_SEL_ALL_SETTINGS, &settings, &bme_dev_);
     if (rslt != BME280_OK) {
         return rslt;
     }
 
-    rslt = bme280_cal_meas_delay(&bme_meas_delay_us_, &settings);
-    return rslt;
-};
+    return bme280_cal_meas_delay(&bme_meas_delay_us_, &settings);
+}
 
 int8_t bme280_measure(int32_t *pres) {
     // Start a measurement
@@ -52,18 +59,44 @@ int8_t bme280_measure(int32_t *pres) {
     if (rslt != BME280_OK) {
         return rslt;
     }
+    TICK_PROFILER_MARK(TICK_PHASE_TRIGGER);
+
+    // Wait until measurement is ready. There's nothing to do meanwhile so do it slowly.
+    clock_speed speed = clock_get();
+    clock_set(CLOCK_SLOW);
+    clock_delay_us(bme_meas_delay_us_);
+    clock_set(speed);
+    TICK_PROFILER_MARK(TICK_PHASE_CONVERSION);
+
+    // Read pressure and temperature but skip humidity, which we don't sample. This is
+    // bme280_get_sensor_data split up so the bus and the math can be timed separately.
+    uint8_t reg_data[BME280_LEN_P_T_DATA];
+    rslt = bme280_get_regs(BME280_REG_DATA, reg_data, BME280_LEN_P_T_DATA, &bme_dev_);
+    if (rslt != BME280_OK) {
+        return rslt;
+    }
+    TICK_PROFILER_MARK(TICK_PHASE_I2C_READ);
 
-    // Sleep until measurement is ready
-    _delay_us(bme_meas_delay_us_);
+    struct bme280_uncomp_data uncomp_data {};
+    uncomp_data.pressure =
+        ((uint32_t)reg_data[0] << 12) | ((uint32_t)reg_data[1] << 4) | (reg_data[2] >> 4);
+    uncomp_data.temperature =
+        ((uint32_t)reg_data[3] << 12) | ((uint32_t)reg_data[4] << 4) | (reg_data[5] >> 4);
 
-    // Measure
     struct bme280_data data {};
-    rslt = bme280_get_sensor_data(BME280_PRESS, &data, &bme_dev_);
+    rslt = bme280_compensate_data(BME280_PRESS, &uncomp_data, &data, &bme_dev_.calib_data);
     if (rslt != BME280_OK) {
         return rslt;
     }
 
     *pres = data.pressure;
+    TICK_PROFILER_MARK(TICK_PHASE_COMPENSATION);
+
+#ifdef BENCH
+    // Keep the real sensor traffic and compensation but feed the state machine a
+    // scripted flight so every benchmark run takes the same path
+    *pres = bench_pressure();
+#endif
 
     return 0;
 }
@@ -113,4 +146,4 @@ BME280_INTF_RET_TYPE bme280_i2c_write(uint8_t reg_addr, const uint8_t *reg_data,
     return BME280_OK;
 }
 
-void bme280_delay_us(uint32_t period_us, void *intf_ptr) { _delay_us(period_us); }
+void bme280_delay_us(uint32_t period_us, void *intf_ptr) { clock_delay_us(period_us); }
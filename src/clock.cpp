@@ -0,0 +1,93 @@
+#include "clock.h"
+
+#include "avr/io.h"
+#include "util/delay_basic.h"
+
+#include "tick_profiler.h"
+#include "usart_debug.h"
+
+// Same as TinyI2C's TWI0_BAUD, clamped since it goes negative at low clock speeds
+#define TWI_MBAUD(f_clk_per, f_scl, t_rise_us)                                                      \
+    ((float)(f_clk_per) / (f_scl) - 10 - (float)(f_clk_per) * (t_rise_us) / 1000000 > 0            \
+         ? (uint8_t)(((float)(f_clk_per) / (f_scl) - 10 - (float)(f_clk_per) * (t_rise_us) / 1000000) / 2) \
+         : 0)
+#define USART_BAUD(f_clk_per, baud) (uint16_t)((float)(f_clk_per) * 64 / (16 * (float)(baud)) + 0.5)
+
+// Must match TinyI2C and usart_debug
+#define F_SCL 100000
+#define T_RISE_US 2
+#define USART_DEBUG_BAUD 9600
+
+struct clock_config {
+    uint8_t pdiv;
+    uint8_t shift;
+    uint8_t twi_mbaud;
+    uint16_t usart_baud;
+};
+
+#define CLOCK_CONFIG(pdiv, shift)                                                                   \
+    {pdiv, shift, TWI_MBAUD(F_CLK_PER << shift, F_SCL, T_RISE_US),                     \
+     USART_BAUD(F_CLK_PER << shift, USART_DEBUG_BAUD)}
+
+static const clock_config configs_[] = {
+    CLOCK_CONFIG(CLKCTRL_PDIV_64X_gc, 0),
+    CLOCK_CONFIG(CLKCTRL_PDIV_4X_gc, 4),
+    CLOCK_CONFIG(CLKCTRL_PDIV_2X_gc, 5),
+};
+
+static clock_speed speed_ = CLOCK_SLOW;
+
+void clock_init() {
+    CPU_CCP = CCP_IOREG_gc; /* Enable writing to protected register MCLKCTRLB */
+    CLKCTRL.MCLKCTRLB = CLKCTRL_PEN_bm | configs_[CLOCK_SLOW].pdiv;
+    speed_ = CLOCK_SLOW;
+}
+
+void clock_set(clock_speed speed) {
+    if (speed == speed_) {
+        return;
+    }
+    const clock_config *c = &configs_[speed];
+
+    // A byte on the wire would be garbled by the baud rate changing under it
+    USART_DEBUG_DRAIN();
+    TICK_PROFILER_CLOCK_CHANGE();
+
+    uint8_t sreg = SREG;
+    __asm__ __volatile__("cli" ::: "memory");
+
+    CPU_CCP = CCP_IOREG_gc;
+    CLKCTRL.MCLKCTRLB = CLKCTRL_PEN_bm | c->pdiv;
+    USART1.BAUD = c->usart_baud;
+    // MBAUD may only change with the master disabled, and the bus is idle between ticks
+    if (TWI0.MCTRLA & TWI_ENABLE_bm) {
+        TWI0.MCTRLA = 0;
+        TWI0.MBAUD = c->twi_mbaud;
+        TWI0.MCTRLA = TWI_ENABLE_bm;
+        TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+    } else {
+        TWI0.MBAUD = c->twi_mbaud;
+    }
+    speed_ = speed;
+
+    SREG = sreg;
+}
+
+clock_speed clock_get() { return speed_; }
+
+uint8_t clock_shift() { return configs_[speed_].shift; }
+
+// _delay_loop_2 takes 4 cycles a count, so at F_CLK_PER a whole number of counts every
+// 64us and twice that for each step up in clock_shift
+#define DELAY_COUNTS_PER_64US (F_CLK_PER * 64 / 4 / 1000000)
+static_assert(F_CLK_PER * 64 / 4 % 1000000 == 0, "F_CLK_PER needs a rounded DELAY_COUNTS_PER_64US");
+
+void clock_delay_us(uint32_t us) {
+    uint32_t counts = (us * DELAY_COUNTS_PER_64US << clock_shift()) >> 6;
+    for (; counts > UINT16_MAX; counts -= UINT16_MAX) {
+        _delay_loop_2(UINT16_MAX);
+    }
+    if (counts) {
+        _delay_loop_2(counts);
+    }
+}
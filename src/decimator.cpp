@@ -0,0 +1,21 @@
+#include "decimator.h"
+
+static int32_t sum_;
+static uint8_t reads_, count_;
+
+void decimator_init(uint8_t reads) {
+    reads_ = reads;
+    sum_ = 0;
+    count_ = 0;
+}
+
+bool decimator_add(int32_t pressure_pa, int32_t *average_pa) {
+    sum_ += pressure_pa;
+    if (++count_ < reads_) {
+        return false;
+    }
+    *average_pa = (sum_ + reads_ / 2) / reads_;
+    sum_ = 0;
+    count_ = 0;
+    return true;
+}
@@ -0,0 +1,57 @@
+#include "eeprom_dump.h"
+
+#include "avr/eeprom.h"
+#include "avr/io.h"
+#include "util/crc16.h"
+
+#include "clock.h"
+
+// Run the dump at CLOCK_MAX rather than 312.5khz so we can use a fast baud rate
+#define DUMP_F_CLK_PER (F_CLK_PER << 5)
+
+static void send(uint8_t byte) {
+    while (!(USART1.STATUS & USART_DREIF_bm)) {
+        ;
+    }
+    USART1.TXDATAL = byte;
+}
+
+static void send_u16(uint16_t val) {
+    send(val & 0xFF);
+    send(val >> 8);
+}
+
+void eeprom_dump() {
+    // Put the debug USART back how we found it afterwards. The clock manager
+    // restores its baud rate.
+    uint8_t ctrlb = USART1.CTRLB;
+    clock_speed speed = clock_get();
+    clock_set(CLOCK_MAX);
+
+    PORTMUX.USARTROUTEA |= PORTMUX_USART1_ALT1_gc;
+    VPORTC.DIR |= PIN2_bm; // TxD on PC2
+    USART1.BAUD = (uint16_t)((float)(DUMP_F_CLK_PER * 64 / (16 * (float)EEPROM_DUMP_BAUD)) + 0.5);
+    USART1.CTRLB = USART_TXEN_bm;
+
+    send('A');
+    send('L');
+    send('T');
+    send('D');
+    send_u16(EEPROM_SIZE);
+
+    uint16_t crc = 0xFFFF;
+    for (uint16_t addr = 0; addr < EEPROM_SIZE; addr++) {
+        uint8_t byte = eeprom_read_byte((const uint8_t *)addr);
+        crc = _crc_ccitt_update(crc, byte);
+        send(byte);
+    }
+    send_u16(crc);
+
+    // Let the last byte out before slowing the clock back down under it
+    USART1.STATUS = USART_TXCIF_bm;
+    while (!(USART1.STATUS & USART_TXCIF_bm)) {
+        ;
+    }
+    USART1.CTRLB = ctrlb;
+    clock_set(speed);
+}
@@ -0,0 +1,77 @@
+#include "flight_phase.h"
+
+#include "clock.h"
+
+// Falling and this far below the maximum is past apogee. The speed is filtered so its
+// sign is most of it, the margin keeps a lull in a kite's climb from counting.
+#define APOGEE_HYSTERESIS_PA 10
+// Slower than this and within LANDED_BAND_PA of one altitude for LANDED_RTC is landed,
+// as long as we're below LANDED_FRACTION of the way up so a kite holding station
+// doesn't count
+#define LANDED_SPEED_PA 20
+#define LANDED_BAND_PA 20
+#define LANDED_RTC (RTC_HZ * 5L)
+#define LANDED_FRACTION_SHIFT 2 // 1/4
+
+static flight_phase phase_;
+static int32_t max_altitude_, still_altitude_;
+static int16_t peak_velocity_;
+static uint32_t elapsed_rtc_, apogee_rtc_, still_rtc_;
+
+void flight_phase_init() {
+    phase_ = FLIGHT_PHASE_BOOST;
+    max_altitude_ = still_altitude_ = 0;
+    peak_velocity_ = 0;
+    elapsed_rtc_ = apogee_rtc_ = still_rtc_ = 0;
+}
+
+flight_phase flight_phase_update(int32_t altitude_pa, int16_t velocity_pa, uint16_t elapsed_rtc) {
+    elapsed_rtc_ += elapsed_rtc;
+
+    if (altitude_pa > max_altitude_) {
+        max_altitude_ = altitude_pa;
+        apogee_rtc_ = elapsed_rtc_;
+    }
+
+    switch (phase_) {
+    case FLIGHT_PHASE_BOOST:
+        if (velocity_pa > peak_velocity_) {
+            peak_velocity_ = velocity_pa;
+        } else if (velocity_pa < peak_velocity_) {
+            phase_ = FLIGHT_PHASE_COAST;
+        }
+        // Fall through, a short boost can end at apogee
+    case FLIGHT_PHASE_COAST:
+        if (velocity_pa < 0 && altitude_pa <= max_altitude_ - APOGEE_HYSTERESIS_PA) {
+            phase_ = FLIGHT_PHASE_APOGEE;
+        }
+        break;
+    case FLIGHT_PHASE_APOGEE:
+        phase_ = FLIGHT_PHASE_DESCENT;
+        // Fall through
+    case FLIGHT_PHASE_DESCENT:
+        if (velocity_pa > LANDED_SPEED_PA || velocity_pa < -LANDED_SPEED_PA ||
+            altitude_pa > still_altitude_ + LANDED_BAND_PA ||
+            altitude_pa < still_altitude_ - LANDED_BAND_PA) {
+            still_altitude_ = altitude_pa;
+            still_rtc_ = 0;
+        } else {
+            still_rtc_ += elapsed_rtc;
+            if (still_rtc_ >= LANDED_RTC && altitude_pa <= (max_altitude_ >> LANDED_FRACTION_SHIFT)) {
+                phase_ = FLIGHT_PHASE_LANDED;
+            }
+        }
+        break;
+    case FLIGHT_PHASE_LANDED:
+        break;
+    }
+    return phase_;
+}
+
+int32_t flight_phase_max_altitude_pa() { return max_altitude_; }
+
+uint32_t flight_phase_apogee_rtc() { return apogee_rtc_; }
+
+uint32_t flight_phase_duration_rtc() {
+    return phase_ == FLIGHT_PHASE_LANDED ? elapsed_rtc_ - still_rtc_ : elapsed_rtc_;
+}
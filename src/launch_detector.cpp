@@ -0,0 +1,36 @@
+#include "launch_detector.h"
+
+// Baseline and sum are in 1/16 Pa. The baseline is an EMA with weight 1/8.
+#define FRAC_BITS 4
+#define EMA_SHIFT 3
+
+static int32_t baseline_;
+static int32_t sum_;
+static int16_t drift_;
+static int32_t threshold_;
+
+void launch_detector_init(uint8_t drift_pa, uint16_t threshold_pa) {
+    drift_ = (int16_t)drift_pa << FRAC_BITS;
+    threshold_ = (int32_t)threshold_pa << FRAC_BITS;
+}
+
+void launch_detector_reset(int32_t baseline_pa) {
+    baseline_ = baseline_pa << FRAC_BITS;
+    sum_ = 0;
+}
+
+void launch_detector_track(int32_t pressure_pa) {
+    baseline_ += ((pressure_pa << FRAC_BITS) - baseline_) >> EMA_SHIFT;
+}
+
+bool launch_detector_update(int32_t pressure_pa) {
+    int32_t p = pressure_pa << FRAC_BITS;
+    sum_ += baseline_ - p - drift_;
+    if (sum_ <= 0) {
+        sum_ = 0;
+        baseline_ += (p - baseline_) >> EMA_SHIFT;
+    }
+    return sum_ >= threshold_;
+}
+
+bool launch_detector_quiet() { return sum_ == 0; }
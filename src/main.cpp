@@ -4,76 +4,193 @@
 #include "avr/sleep.h"
 #include "util/delay.h"
 
+#include "altitude_filter.h"
 #include "bme280_client.h"
+#include "clock.h"
+#include "decimator.h"
+#include "eeprom_dump.h"
+#include "flight_phase.h"
+#include "launch_detector.h"
+#include "mode_store.h"
+#include "profiles.h"
 #include "recorder.h"
+#include "telemetry.h"
+#include "tick_profiler.h"
 #include "usart_debug.h"
 
-// This is not really linear but should be close enough to only introduce
-// a few percent error assuming we're launching from near sea level, only
-// going ~1000ft and operating around ambient temperature
-
-#define MODE_ROCKET 0
-#define MODE_THROW 1
-#define MODE_ELECTRIC 2
-#define MODE_KITE 3
-
-#define CURRENT_MODE MODE_ROCKET
-
-#if CURRENT_MODE == MODE_ROCKET
-#define PA_INTERVAL 18 // 5 feet interval
-#define FAST_INTERVAL_INVERSE_SECS 8
-#define SLOW_INTERVAL_SECS 1
-#define FAST_INTERVAL_RECORDS 80
-#define START_DELTA_THRESHOLD_INTERVALS 3 // Start launch tracking after this size delta
-#elif CURRENT_MODE == MODE_THROW
-#define PA_INTERVAL 5 // ~1.5'
-#define FAST_INTERVAL_INVERSE_SECS 10
-#define SLOW_INTERVAL_SECS 1
-#define FAST_INTERVAL_RECORDS 200
-#define START_DELTA_THRESHOLD_INTERVALS 1 // Start launch tracking after this size delta
-#elif CURRENT_MODE == MODE_ELECTRIC
-#define PA_INTERVAL 17 // ~5'
-#define FAST_INTERVAL_INVERSE_SECS 4
-#define SLOW_INTERVAL_SECS 1
-#define FAST_INTERVAL_RECORDS 40
-#define START_DELTA_THRESHOLD_INTERVALS 1 // Start launch tracking after this size delta
-#elif CURRENT_MODE == MODE_KITE
-#define PA_INTERVAL 11 // ~3'
-#define FAST_INTERVAL_INVERSE_SECS 2
-#define SLOW_INTERVAL_SECS 1
-#define FAST_INTERVAL_RECORDS 256
-#define START_DELTA_THRESHOLD_INTERVALS 1 // Start launch tracking after this size delta
+// Armed on the pad we take a coarse sample every ARMED_INTERVAL_RTC and only look for
+// pressure starting to fall, then go on alert: full rate and precision, with the launch
+// detector deciding. Alert lapses once the detector has been quiet for a while.
+#define ARMED_INTERVAL_RTC (RTC_HZ / 2)
+#define ARMED_ESCALATE_PA 12 // ~3', a few times the noise at 1x oversampling
+#define ALERT_TIMEOUT_RTC (RTC_HZ * 2)
+
+// Intervals are in RTC counts and the RTC period register is 16 bits
+static_assert(ARMED_INTERVAL_RTC <= UINT16_MAX, "ARMED_INTERVAL_RTC too long");
+
+// Each of a sample's decimation readings needs an 8x conversion (22.5ms at most) and the
+// bus traffic done before the next tick
+#define MIN_READ_INTERVAL_RTC (RTC_HZ / 40)
+
+// Alert samples kept in RAM so the log starts this many samples before launch is
+// detected, catching a slow start or a throw's wind-up
+#ifndef PRELAUNCH_SAMPLES
+#define PRELAUNCH_SAMPLES 6
 #endif
+static_assert(PRELAUNCH_SAMPLES >= 1 && PRELAUNCH_SAMPLES <= UINT8_MAX, "PRELAUNCH_SAMPLES out of range");
+
+// Hold the button this long at boot to dump EEPROM over USART instead of flying
+#define DUMP_HOLD_MS 2000
+// Press again within this long of letting go to switch to the next profile. Ignore
+// the first few ms after letting go, which could be contact bounce.
+#define DOUBLE_PRESS_MS 400
+#define DEBOUNCE_MS 30
+
+enum button_press : uint8_t {
+    BUTTON_PRESS,
+    BUTTON_DOUBLE, // Two presses within DOUBLE_PRESS_MS
+    BUTTON_HOLD,   // Held for DUMP_HOLD_MS
+};
+
+// Rewrite the summary header this often in flight as well as on each phase change
+#define SUMMARY_INTERVAL_RECORDS 16
+// Pressure drop per 10 feet near sea level, to blink the maximum altitude in feet
+#define PA_PER_10_FEET 36
 
 int32_t last_pressure_pa_;
 bool running_;
+flight_phase phase_;
+bool alert_;
+uint8_t alert_ticks_;
+volatile bool tick_;
 
 int32_t start_pressure_pa_;
+// From start_pressure_pa_'s sample to the oldest one in the prelaunch ring, and so to
+// the first record
+uint16_t start_rtc_;
 int16_t last_altitude_intervals_;
-uint8_t n_records_ = 0;
+uint16_t n_records_ = 0;
+uint8_t flight_;
+uint16_t tick_interval_rtc_;
+// Readings per sample, the profile's decimation once on alert
+uint8_t reads_per_sample_ = 1;
 
-// Returns whether there is more room to keep recording
+int32_t prelaunch_pa_[PRELAUNCH_SAMPLES];
+uint8_t prelaunch_head_, prelaunch_count_;
+
+// Returns false once EEPROM is full
 bool record_delta(int8_t delta_intervals_from_last) {
-    usart_debug_send(delta_intervals_from_last);
-    bool res = recorder_record(delta_intervals_from_last);
+    TELEMETRY_DELTA(delta_intervals_from_last);
+    if (!recorder_record(delta_intervals_from_last)) {
+        return false;
+    }
     last_altitude_intervals_ += delta_intervals_from_last;
     n_records_++;
-    return res;
+    return true;
 }
 
-int8_t get_record_delta(int32_t pressure_pa) {
-    // TODO: check this math or, better, write tests.
+template <const flight_profile &P> int8_t get_record_delta(int32_t altitude_pa) {
     // Calculate all deltas relative to launch pressure so that we don't drift because
-    // of repeated rounding to intervals
-    int16_t delta_intervals_from_launch = (start_pressure_pa_ - pressure_pa) / PA_INTERVAL;
+    // of repeated rounding to intervals. pa_interval promotes to int so this is a signed
+    // divide truncating toward zero, as flight_sim's cdiv does. The int8_t only wraps for
+    // steps over 127 intervals (2286 Pa a sample for rocket), far beyond any flight.
+    int16_t delta_intervals_from_launch = altitude_pa / P.pa_interval;
     return delta_intervals_from_launch - last_altitude_intervals_;
 }
 
+// Run a sample elapsed_rtc after the last through the altitude filter, returning the
+// altitude to record. That's the raw reading unless built with LOG_FILTERED_ALTITUDE.
+int32_t filter_sample(int32_t pressure_pa, uint16_t elapsed_rtc) {
+    int32_t altitude_pa = start_pressure_pa_ - pressure_pa;
+    altitude_filter_update(altitude_pa, elapsed_rtc);
+    TELEMETRY_FILTER(altitude_filter_altitude(), altitude_filter_velocity());
+#ifdef LOG_FILTERED_ALTITUDE
+    altitude_pa = altitude_filter_altitude() >> ALTITUDE_FILTER_FRAC_BITS;
+#endif
+    return altitude_pa;
+}
+
+void prelaunch_push(int32_t pressure_pa) {
+    prelaunch_pa_[prelaunch_head_] = pressure_pa;
+    prelaunch_head_ = prelaunch_head_ + 1 == PRELAUNCH_SAMPLES ? 0 : prelaunch_head_ + 1;
+    if (prelaunch_count_ < PRELAUNCH_SAMPLES) {
+        prelaunch_count_++;
+    } else if (start_rtc_ <= UINT16_MAX - tick_interval_rtc_) {
+        // Dropped the oldest, so the log starts a sample later
+        start_rtc_ += tick_interval_rtc_;
+    }
+}
+
+// Record the saved pad history, oldest first
+template <const flight_profile &P> void prelaunch_flush() {
+    uint8_t i = prelaunch_head_ >= prelaunch_count_
+                    ? prelaunch_head_ - prelaunch_count_
+                    : prelaunch_head_ + PRELAUNCH_SAMPLES - prelaunch_count_;
+    uint16_t elapsed_rtc = start_rtc_;
+    for (; prelaunch_count_; prelaunch_count_--) {
+        record_delta(get_record_delta<P>(filter_sample(prelaunch_pa_[i], elapsed_rtc)));
+        i = i + 1 == PRELAUNCH_SAMPLES ? 0 : i + 1;
+        elapsed_rtc = tick_interval_rtc_;
+    }
+}
+
+uint16_t rtc_to_ds(uint32_t rtc) {
+    uint32_t ds = rtc * 10 / RTC_HZ;
+    return ds > UINT16_MAX ? UINT16_MAX : ds;
+}
+
 void led_on() { VPORTB.OUT |= PIN2_bm; }
 
 void led_off() { VPORTB.OUT &= ~PIN2_bm; }
 
-void wait_for_button() {
+// Blink count for 1-9, one long blink for 0
+void blink_digit(uint8_t digit) {
+    if (digit == 0) {
+        led_on();
+        _delay_ms(1000);
+        led_off();
+        _delay_ms(300);
+        return;
+    }
+    for (; digit; digit--) {
+        led_on();
+        _delay_ms(300);
+        led_off();
+        _delay_ms(300);
+    }
+}
+
+// Read out the last flight's maximum altitude in feet, most significant digit first.
+// Runs at CLOCK_SLOW, which is what F_CPU assumes.
+void blink_summary() {
+    log_header header;
+    if (!recorder_read_header(&header) || header.mode >= N_MODES) {
+        return;
+    }
+    int32_t feet = (int32_t)header.max_altitude_intervals * PROFILES[header.mode]->pa_interval * 10 / PA_PER_10_FEET;
+    uint16_t place = 10000;
+    while (place > 1 && place > feet) {
+        place /= 10;
+    }
+    for (; place; place /= 10) {
+        blink_digit(feet / place % 10);
+        _delay_ms(1000);
+    }
+}
+
+// Quick flashes, one more than mode (rocket 1, throw 2...), to tell apart from digits
+void blink_mode(uint8_t mode) {
+    for (uint8_t i = 0; i <= mode; i++) {
+        led_on();
+        _delay_ms(100);
+        led_off();
+        _delay_ms(200);
+    }
+    _delay_ms(700);
+}
+
+// Sleep until the button is pressed, then tell a press from a hold or double press
+button_press wait_for_button() {
     // Button is on PA4
     // Enable pull-up
     PORTA.PIN4CTRL |= PORT_PULLUPEN_bm;
@@ -86,26 +203,191 @@ void wait_for_button() {
     sleep_mode();
 
     cli();
+
+    // Light the LED while the button is held, in 10ms steps
+    uint8_t held = 0;
+    led_on();
+    while (!(VPORTA.IN & PIN4_bm) && held < DUMP_HOLD_MS / 10) {
+        _delay_ms(10);
+        held++;
+    }
+    led_off();
+
+    button_press press = held >= DUMP_HOLD_MS / 10 ? BUTTON_HOLD : BUTTON_PRESS;
+    if (press == BUTTON_PRESS) {
+        _delay_ms(DEBOUNCE_MS);
+        for (uint8_t gap = 0; gap < (DOUBLE_PRESS_MS - DEBOUNCE_MS) / 10; gap++) {
+            if (!(VPORTA.IN & PIN4_bm)) {
+                press = BUTTON_DOUBLE;
+                while (!(VPORTA.IN & PIN4_bm)) {
+                    _delay_ms(10);
+                }
+                break;
+            }
+            _delay_ms(10);
+        }
+    }
+
+    PORTA.PIN4CTRL = 0;
+    return press;
+}
+
+// Whether the button is held as the unit powers on, which asks for the last flight's
+// readout. Waits for it to be let go so it doesn't also count as a press.
+bool button_held_at_boot() {
+    PORTA.PIN4CTRL = PORT_PULLUPEN_bm;
+    _delay_ms(1); // Let the pull-up charge the line
+    bool held = !(VPORTA.IN & PIN4_bm);
+    while (!(VPORTA.IN & PIN4_bm)) {
+        _delay_ms(10);
+    }
+    _delay_ms(DEBOUNCE_MS);
     PORTA.PIN4CTRL = 0;
+    return held;
+}
+
+// One sample every rtc_counts, give or take rounding to a whole number of reads, with
+// the tick firing for each of its reads
+void set_tick_interval(uint16_t rtc_counts) {
+    uint16_t read_rtc = rtc_counts / reads_per_sample_;
+    uint16_t per = read_rtc - 1;
+    // PER is synchronised into the RTC's own clock domain, and writing it again before
+    // that finishes is ignored
+    while (RTC.STATUS & RTC_PERBUSY_bm) {
+        ;
+    }
+    RTC.PER = per;
+    while (RTC.STATUS & RTC_PERBUSY_bm) {
+        ;
+    }
+    // A counter already past the shorter period would run on to 0xFFFF and wrap, 8s
+    // late, so start this interval from now instead
+    if (RTC.CNT > per) {
+        while (RTC.STATUS & RTC_CNTBUSY_bm) {
+            ;
+        }
+        RTC.CNT = 0;
+    }
+    tick_interval_rtc_ = read_rtc * reads_per_sample_;
+}
+
+// Overflow interrupt every interval RTC counts. The RTC runs from the 32khz
+// oscillator so the tick keeps going in standby with the main clock stopped.
+void start_tick(uint16_t rtc_counts) {
+    while (RTC.STATUS) {
+        ;
+    }
+    RTC.CLKSEL = RTC_CLKSEL_INT32K_gc;
+    RTC.CNT = 0;
+    set_tick_interval(rtc_counts);
+    RTC.INTCTRL = RTC_OVF_bm;
+    while (RTC.STATUS & RTC_CTRLABUSY_bm) {
+        ;
+    }
+    RTC.CTRLA = RTC_PRESCALER_DIV4_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
+}
+
+void stop_tick() {
+    while (RTC.STATUS & RTC_CTRLABUSY_bm) {
+        ;
+    }
+    RTC.CTRLA = 0;
+}
+
+// Sleep until the tick fires, going back to sleep on any other wakeup such as
+// USART transmit interrupts
+void sleep_until_tick() {
+    cli();
+    while (!tick_) {
+        // Standby would stop the USART mid-transmission
+        set_sleep_mode(USART_DEBUG_BUSY() ? SLEEP_MODE_IDLE : SLEEP_MODE_STANDBY);
+        sleep_enable();
+        sei(); // The instruction after sei always runs so the tick can't slip in before we sleep
+        sleep_cpu();
+        sleep_disable();
+        cli();
+    }
+    tick_ = false;
+    sei();
 }
 
 void error() {
-    set_sleep_mode(SLEEP_MODE_STANDBY);
-    TCA0.SINGLE.PER = F_CLK_PER / 20 / 16; // 20hz
+    clock_set(CLOCK_SLOW);
+    stop_tick();
+    reads_per_sample_ = 1; // Or set_tick_interval splits the blink across decimated reads
+    start_tick(RTC_HZ / 20); // 20hz
     while (1) {
         led_on();
-        sleep_mode();
+        sleep_until_tick();
         led_off();
-        sleep_mode();
+        sleep_until_tick();
     }
 }
 
+// Interrupt when VDD falls to 25% above the BOD level, so the end of the log can be
+// committed on the remaining charge if the battery comes loose. Needs the BOD enabled
+// by the BODCFG fuse, see platformio.ini.
+void start_brownout_watch() {
+    BOD.VLMCTRLA = BOD_VLMLVL_25ABOVE_gc;
+    BOD.INTCTRL = BOD_VLMCFG_FALLING_gc | BOD_VLMIE_bm;
+}
+
+void stop_brownout_watch() { BOD.INTCTRL = 0; }
+
+// Bring the summary at the start of EEPROM up to date
+template <const flight_profile &P> void write_summary(uint8_t state) {
+    log_header header = {
+        LOG_MAGIC,
+        P.mode,
+        phase_,
+        state,
+        flight_,
+        n_records_,
+        (int16_t)(flight_phase_max_altitude_pa() / P.pa_interval),
+        rtc_to_ds(flight_phase_apogee_rtc()),
+        rtc_to_ds(flight_phase_duration_rtc()),
+        start_rtc_,
+    };
+    recorder_write_header(&header);
+}
+
+// Power down, waking only to read out the summary or dump EEPROM
+void power_down() {
+    TELEMETRY_STATE(TELEMETRY_STATE_DONE, n_records_);
+    TICK_PROFILER_DUMP();
+    USART_DEBUG_DRAIN();
+    led_off();
+    clock_set(CLOCK_SLOW);
+    stop_tick();
+    // Let the last EEPROM write finish before everything stops
+    while (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm) {
+        ;
+    }
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    while (1) {
+        if (wait_for_button() == BUTTON_HOLD) {
+            led_on();
+            eeprom_dump();
+            led_off();
+        } else {
+            blink_summary();
+        }
+    }
+}
+
+template <const flight_profile &P> void finish_flight() {
+    stop_brownout_watch();
+    recorder_commit();
+    write_summary<P>(LOG_STOPPED);
+    power_down();
+}
+
 void test_measuring_and_recording() {
     if (bme280_measure(&last_pressure_pa_) != BME280_OK) {
         error();
     };
     for (int i = 0; i < 30; i++) {
-        sleep_mode();
+        sleep_until_tick();
         led_on();
 
         int32_t pressure_pa;
@@ -119,7 +401,7 @@ void test_measuring_and_recording() {
             delta_pa = INT8_MIN;
         }
 
-        usart_debug_send(delta_pa);
+        TELEMETRY_DELTA(delta_pa);
         if (!recorder_record_test_byte(delta_pa)) {
             break;
         }
@@ -134,7 +416,7 @@ void test_measuring_and_recording() {
 
 void test_measuring_and_printing() {
     while (1) {
-        sleep_mode();
+        sleep_until_tick();
         led_on();
 
         int32_t pressure_pa;
@@ -142,51 +424,31 @@ void test_measuring_and_printing() {
             error();
         };
 
-        usart_debug_send('+');
-        usart_debug_send(pressure_pa & 0xff);
-        usart_debug_send((pressure_pa >> 8) & 0xff);
-        usart_debug_send((pressure_pa >> 16) & 0xff);
+        TELEMETRY_PRESSURE(pressure_pa);
 
         led_off();
     }
 }
 
-int main(void) {
-    CPU_CCP = CCP_IOREG_gc; /* Enable writing to protected register MCLKCTRLB */
-    CLKCTRL.MCLKCTRLB = CLKCTRL_PEN_bm | CLKCTRL_PDIV_64X_gc; // Divide main clock by 64 = 312500hz
-
-    VPORTB.DIR |= PIN2_bm; // Configure LED for output
-    usart_debug_init();
-
-    set_sleep_mode(SLEEP_MODE_STANDBY);
-    wait_for_button(); // Must configure sleep first
-    // Standby seems to screw things some things up and we won't be in this mode
-    // for more than a few minutes
-    set_sleep_mode(SLEEP_MODE_IDLE);
-
-    // Get an initial pressure value
-    if (bme280_init() != BME280_OK) {
-        error();
-    }
-
-    TCA0.SINGLE.INTCTRL = TCA_SINGLE_OVF_bm;
-    // NB: This needs to match the divider set in CTRLA and needs to support 3s intervals
-    TCA0.SINGLE.PER = F_CLK_PER / FAST_INTERVAL_INVERSE_SECS / 16;
-    TCA0.SINGLE.CTRLA = TCA_SINGLE_RUNSTDBY_bm | TCA_SINGLE_ENABLE_bm | TCA_SINGLE_CLKSEL_DIV16_gc;
+// The flight loop from the pad to landing, built once for each profile so its constants
+// are folded in. Never returns.
+template <const flight_profile &P> void fly() {
+    constexpr uint16_t alert_ticks = ALERT_TIMEOUT_RTC / P.fast_interval_rtc;
+    static_assert(alert_ticks >= 1 && alert_ticks <= UINT8_MAX, "ALERT_TIMEOUT_RTC out of range");
+    static_assert(P.decimation >= 1, "decimation out of range");
+    static_assert(P.fast_interval_rtc / P.decimation >= MIN_READ_INTERVAL_RTC, "decimation too high for fast_interval_rtc");
 
-    sei();
-
-    //test_measuring_and_printing();
-    //test_measuring_and_recording();
-
-    // Get an initial reading
-    if (bme280_measure(&last_pressure_pa_) != BME280_OK) {
-        error();
-    };
+    launch_detector_init(P.cusum_drift_pa, P.cusum_threshold_pa);
+    launch_detector_reset(last_pressure_pa_);
 
     while (1) {
-        sleep_mode(); // Enter standby until the timer wakes us
+        clock_set(CLOCK_SLOW);
+        sleep_until_tick();
 
+        TICK_PROFILER_START();
+        // Race through the I2C traffic and compensation math, bme280_measure drops
+        // back down while it waits on the conversion
+        clock_set(CLOCK_FAST);
         led_on();
 
         int32_t pressure_pa;
@@ -194,34 +456,179 @@ int main(void) {
             error();
         };
 
+        // Past the pad, only every reads_per_sample_ readings make a sample
+        if (alert_ && !decimator_add(pressure_pa, &pressure_pa)) {
+            TICK_PROFILER_END();
+            led_off();
+            continue;
+        }
+
         if (running_) {
-            if (!record_delta(get_record_delta(pressure_pa))) {
-                led_off();
-                // Stop recording until power cycles once we fill EEPROM
-                TCA0.SINGLE.CTRLA = 0;
-                set_sleep_mode(SLEEP_MODE_STANDBY);
-                sleep_mode();
+            int8_t delta = get_record_delta<P>(filter_sample(pressure_pa, tick_interval_rtc_));
+            TICK_PROFILER_MARK(TICK_PHASE_DELTA);
+            bool more = record_delta(delta);
+            TICK_PROFILER_MARK(TICK_PHASE_ENCODE);
+            TICK_PROFILER_END();
+            int32_t altitude_pa = altitude_filter_altitude() >> ALTITUDE_FILTER_FRAC_BITS;
+            int16_t velocity_pa = altitude_filter_velocity() >> ALTITUDE_FILTER_FRAC_BITS;
+            flight_phase phase = flight_phase_update(altitude_pa, velocity_pa, tick_interval_rtc_);
+            bool phase_changed = phase != phase_;
+            if (phase_changed) {
+                phase_ = phase;
+                TELEMETRY_PHASE(phase);
+            }
+            if (!more || phase == FLIGHT_PHASE_LANDED) {
+                finish_flight<P>();
             }
-            // Switch to 3s increments after 10s
-            if (n_records_ == FAST_INTERVAL_RECORDS) {
-                TCA0.SINGLE.PER = F_CLK_PER * SLOW_INTERVAL_SECS / 16;
+            // Cheap to keep current, only the fields that changed get written
+            if (phase_changed || n_records_ % SUMMARY_INTERVAL_RECORDS == 0) {
+                write_summary<P>(LOG_RECORDING);
             }
+            // Switch to the slow interval once the interesting part is over
+            if (n_records_ == P.fast_interval_records) {
+                set_tick_interval(P.slow_interval_rtc);
+            }
+        } else if (!alert_) {
+            // Armed: one cheap comparison against the last coarse sample
+            if (last_pressure_pa_ - pressure_pa >= ARMED_ESCALATE_PA) {
+                if (bme280_set_precision(BME280_PRECISION_FLIGHT) != BME280_OK) {
+                    error();
+                }
+                // Measure the climb from before pressure started falling, one armed
+                // interval before this sample
+                start_pressure_pa_ = last_pressure_pa_;
+                start_rtc_ = tick_interval_rtc_;
+                reads_per_sample_ = P.decimation;
+                decimator_init(reads_per_sample_);
+                set_tick_interval(P.fast_interval_rtc);
+                alert_ = true;
+                alert_ticks_ = 0;
+                prelaunch_count_ = 0;
+                prelaunch_push(pressure_pa);
+                TELEMETRY_STATE(TELEMETRY_STATE_ALERT, n_records_);
+            } else {
+                launch_detector_track(pressure_pa);
+            }
+            last_pressure_pa_ = pressure_pa;
+            TICK_PROFILER_MARK(TICK_PHASE_DELTA);
+            TICK_PROFILER_END();
+
+            led_off();
         } else {
-            int16_t delta_intervals = (last_pressure_pa_ - pressure_pa) / PA_INTERVAL;
-            if (delta_intervals >= START_DELTA_THRESHOLD_INTERVALS) {
-                record_delta(get_record_delta(last_pressure_pa_));
-                record_delta(get_record_delta(pressure_pa));
+            if (launch_detector_update(pressure_pa)) {
+                flight_ = recorder_begin();
+                start_brownout_watch();
+                altitude_filter_init(P.filter_accel_pa);
+                prelaunch_flush<P>(); // Ends with last_pressure_pa_
+                record_delta(get_record_delta<P>(filter_sample(pressure_pa, tick_interval_rtc_)));
+                flight_phase_init();
                 running_ = true;
+                TELEMETRY_STATE(TELEMETRY_STATE_RECORDING, n_records_);
             } else {
-                start_pressure_pa_ = last_pressure_pa_;
+                // Only count down while nothing looks like it's climbing
+                alert_ticks_ = launch_detector_quiet() ? alert_ticks_ + 1 : 0;
+                if (alert_ticks_ == alert_ticks) {
+                    // False alarm, back to armed
+                    if (bme280_set_precision(BME280_PRECISION_ARMED) != BME280_OK) {
+                        error();
+                    }
+                    reads_per_sample_ = 1;
+                    set_tick_interval(ARMED_INTERVAL_RTC);
+                    alert_ = false;
+                    TELEMETRY_STATE(TELEMETRY_STATE_PAD, n_records_);
+                } else {
+                    prelaunch_push(pressure_pa);
+                }
                 last_pressure_pa_ = pressure_pa;
             }
+            TICK_PROFILER_MARK(TICK_PHASE_DELTA);
+            TICK_PROFILER_END();
 
             led_off();
         }
     }
 }
 
-ISR(TCA0_OVF_vect) { TCA0.SINGLE.INTFLAGS |= TCA_SINGLE_OVF_bm; }
+// Fly the profile for mode, or blink an error for one we don't have
+void fly_mode(uint8_t mode) {
+    switch (mode) {
+    case MODE_ROCKET:
+        fly<ROCKET_PROFILE>();
+        break;
+    case MODE_THROW:
+        fly<THROW_PROFILE>();
+        break;
+    case MODE_ELECTRIC:
+        fly<ELECTRIC_PROFILE>();
+        break;
+    case MODE_KITE:
+        fly<KITE_PROFILE>();
+        break;
+    }
+    error();
+}
+
+int main(void) {
+    clock_init(); // Divide main clock by 64 = 312500hz
+
+    VPORTB.DIR |= PIN2_bm; // Configure LED for output
+    USART_DEBUG_INIT();
+
+    // Read out the last flight if asked for, then which profile is next, while waiting
+    // to be armed
+    uint8_t mode = mode_store_load();
+    if (button_held_at_boot()) {
+        blink_summary();
+    }
+    blink_mode(mode);
+
+    set_sleep_mode(SLEEP_MODE_STANDBY);
+    // Must configure sleep first. Holding the button dumps EEPROM and a double press
+    // switches profile, then we wait again. A single press starts the flight.
+    button_press press;
+    while ((press = wait_for_button()) != BUTTON_PRESS) {
+        if (press == BUTTON_HOLD) {
+            led_on();
+            eeprom_dump();
+            led_off();
+        } else {
+            mode = mode + 1 == N_MODES ? 0 : mode + 1;
+            mode_store_save(mode);
+            blink_mode(mode);
+        }
+    }
+    // Get an initial pressure value
+    if (bme280_init() != BME280_OK) {
+        error();
+    }
+    if (bme280_set_precision(BME280_PRECISION_ARMED) != BME280_OK) {
+        error();
+    }
+
+    start_tick(ARMED_INTERVAL_RTC);
+
+    TICK_PROFILER_INIT();
+
+    sei();
+
+    //test_measuring_and_printing();
+    //test_measuring_and_recording();
+
+    // Get an initial reading
+    if (bme280_measure(&last_pressure_pa_) != BME280_OK) {
+        error();
+    };
+    fly_mode(mode);
+}
+
+ISR(RTC_CNT_vect) {
+    RTC.INTFLAGS = RTC_OVF_bm;
+    tick_ = true;
+}
 
 ISR(PORTA_PORT_vect) {}
+
+ISR(BOD_VLM_vect) {
+    BOD.INTFLAGS = BOD_VLMIF_bm;
+    recorder_commit();
+}
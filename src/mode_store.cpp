@@ -0,0 +1,35 @@
+#include "mode_store.h"
+
+#include "avr/io.h"
+
+#include "profiles.h"
+
+// First byte of the USERROW, which reads as 0xFF until written
+#define MODE_ADDR ((volatile uint8_t *)USER_SIGNATURES_START)
+
+static void wait_for_nvm() {
+    while (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm) {
+        ;
+    }
+}
+
+uint8_t mode_store_load() {
+#ifdef BENCH
+    return DEFAULT_MODE;
+#else
+    uint8_t mode = *MODE_ADDR;
+    return mode < N_MODES ? mode : DEFAULT_MODE;
+#endif
+}
+
+void mode_store_save(uint8_t mode) {
+    if (*MODE_ADDR == mode) {
+        return;
+    }
+    // Like an EEPROM byte: load the page buffer through the memory map, then erase
+    // and write just that byte
+    wait_for_nvm();
+    *MODE_ADDR = mode;
+    _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_PAGEERASEWRITE_gc);
+    wait_for_nvm();
+}
@@ -1,56 +1,176 @@
 #include "recorder.h"
+#include "tick_profiler.h"
+
+#include <stddef.h>
 
 #include "avr/eeprom.h"
 #include "avr/io.h"
+#include "util/atomic.h"
+
+#define LOG_START ((uint8_t *)sizeof(log_header))
 
-// We expect to go up faster than down so allocate more bits to
-// the positive side of the range
-#define MAX_POSITIVE_VALUE 10
-#define MIN_NEGATIVE_VALUE (MAX_POSITIVE_VALUE - 15)
+static_assert(sizeof(log_header) + LOG_BLOCK_SIZE <= RECORDER_EEPROM_SIZE, "No room for the first block");
+static_assert(2 * (EEPROM_SIZE - sizeof(log_header)) <= UINT8_MAX, "log_anchor.n_records too small");
 
-static uint8_t *curr_addr_ = 0, curr_val_ = 0;
+// Shared with recorder_commit from the brownout interrupt, so only changed with
+// interrupts off. block_end_ is the current block's checksum byte.
+static uint8_t *curr_addr_ = LOG_START, *block_end_ = LOG_START + LOG_BLOCK_SIZE - 1;
+static uint8_t curr_val_ = 0, sum_ = 0, flight_ = 0, block_ = 0;
 static bool partial_byte_ = false;
 
-bool record_one(int8_t val) {
+// Where the next block starts from
+static int16_t altitude_intervals_ = 0;
+static uint8_t n_records_ = 0;
+
+static void wait_for_eeprom() {
+    while (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm) {
+        ;
+    }
+}
+
+// For writes outside record_one, so recorder_commit can't start one halfway through
+static void update_byte(uint8_t *addr, uint8_t val) {
+    wait_for_eeprom();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { eeprom_update_byte(addr, val); }
+}
+
+static void write_block_byte(uint8_t val) {
+    eeprom_write_byte(curr_addr_++, val);
+    sum_ += val;
+}
+
+// Nibbles left in the current block
+static uint8_t room() { return (block_end_ - curr_addr_) * 2 - partial_byte_; }
+
+// Mark the end of the nibbles so far, or pad out the block if it's too full for a
+// marker, and return the checksum up to there. Leaves the recorder where it was.
+static uint8_t write_tail() {
+    uint8_t *addr = curr_addr_;
+    uint8_t sum = sum_;
+    bool marker = room() >= 2;
+    uint8_t val;
+    if (partial_byte_) {
+        val = curr_val_ | (marker ? COMMIT_MARKER_LOW : LOG_PADDING) << 4;
+        eeprom_write_byte(addr++, val);
+        sum += val;
+        if (marker) {
+            val = COMMIT_MARKER_HIGH | LOG_PADDING << 4;
+            eeprom_write_byte(addr, val);
+            sum += val;
+        }
+    } else if (marker) {
+        val = COMMIT_MARKER_LOW | COMMIT_MARKER_HIGH << 4;
+        eeprom_write_byte(addr, val);
+        sum += val;
+    }
+    return log_checksum(sum, flight_, block_);
+}
+
+// Finish the current block and start the next one at the current altitude. Returns
+// false if there isn't one with room for nibbles.
+static bool next_block(uint8_t nibbles) {
+    wait_for_eeprom();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        eeprom_write_byte(block_end_, write_tail());
+
+        uint8_t *start = block_end_ + 1;
+        uint8_t *end = (uint8_t)start + LOG_BLOCK_SIZE <= RECORDER_EEPROM_SIZE
+                           ? start + LOG_BLOCK_SIZE - 1
+                           : (uint8_t *)RECORDER_EEPROM_SIZE - 1;
+        // A block too short for its anchor and a byte of log is as good as full
+        if (end - start <= (int16_t)sizeof(log_anchor) || (end - start - sizeof(log_anchor)) * 2 < nibbles) {
+            return false;
+        }
+
+        curr_addr_ = start;
+        block_end_ = end;
+        partial_byte_ = false;
+        sum_ = 0;
+        block_++;
+        log_anchor anchor = {altitude_intervals_, n_records_};
+        const uint8_t *a = (const uint8_t *)&anchor;
+        for (uint8_t i = 0; i < sizeof(anchor); i++) {
+            write_block_byte(a[i]);
+        }
+    }
+    return true;
+}
+
+void record_one(int8_t val) {
     // Shift the range
-    char byte = (val - MIN_NEGATIVE_VALUE) & 0x0f;
+    char byte = log_nibble(val);
 
     if (!partial_byte_) {
         // Store the low bits in memory
-        curr_val_ = byte;
-        partial_byte_ = true;
-        return true;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            curr_val_ = byte;
+            partial_byte_ = true;
+        }
     } else {
+        TICK_PROFILER_MARK(TICK_PHASE_ENCODE);
+        // Wait with interrupts on so the atomic block only covers starting the write
+        wait_for_eeprom();
         // Flush the full value to EEPROM
-        curr_val_ |= (byte << 4);
-        partial_byte_ = false;
-        eeprom_write_byte(curr_addr_, curr_val_);
-        curr_addr_++;
-        return (uint8_t)curr_addr_ < EEPROM_SIZE;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            curr_val_ |= (byte << 4);
+            partial_byte_ = false;
+            write_block_byte(curr_val_);
+        }
+        TICK_PROFILER_MARK(TICK_PHASE_EEPROM_WRITE);
     }
 }
 
+uint8_t recorder_begin() {
+    update_byte(0, 0xFF);
+    uint8_t *flight = (uint8_t *)offsetof(log_header, flight);
+    flight_ = eeprom_read_byte(flight) + 1;
+    update_byte(flight, flight_);
+    return flight_;
+}
+
 bool recorder_record(int8_t val) {
+    uint8_t nibbles = log_record_nibbles(val);
+    if (nibbles > room() && !next_block(nibbles)) {
+        return false;
+    }
+    altitude_intervals_ += val;
+    n_records_++;
+
     if (val > 0) {
         while (val >= MAX_POSITIVE_VALUE) {
-            if (!record_one(MAX_POSITIVE_VALUE)) {
-                return false;
-            };
+            record_one(MAX_POSITIVE_VALUE);
             val -= MAX_POSITIVE_VALUE;
         }
     } else {
         while (val <= MIN_NEGATIVE_VALUE) {
-            if (!record_one(MIN_NEGATIVE_VALUE)) {
-                return false;
-            };
+            record_one(MIN_NEGATIVE_VALUE);
             val -= MIN_NEGATIVE_VALUE;
         }
     }
-    return record_one(val);
+    record_one(val);
+    return true;
 }
 
 bool recorder_record_test_byte(int8_t val) {
     eeprom_write_byte(curr_addr_, val);
     curr_addr_++;
-    return (uint8_t)curr_addr_ < EEPROM_SIZE;
+    return (uint8_t)curr_addr_ < RECORDER_EEPROM_SIZE;
+}
+
+void recorder_commit() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { eeprom_write_byte(block_end_, write_tail()); }
+}
+
+void recorder_write_header(const log_header *header) {
+    // Magic last so a header is never valid until all of it is written
+    const uint8_t *b = (const uint8_t *)header;
+    for (uint8_t i = 1; i < sizeof(log_header); i++) {
+        update_byte((uint8_t *)i, b[i]);
+    }
+    update_byte(0, header->magic);
+}
+
+bool recorder_read_header(log_header *header) {
+    eeprom_read_block(header, 0, sizeof(log_header));
+    return header->magic == LOG_MAGIC;
 }
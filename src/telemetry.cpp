@@ -0,0 +1,67 @@
+#ifdef USART_DEBUG
+
+#include "telemetry.h"
+
+#include "util/crc16.h"
+
+#include "usart_debug.h"
+
+// type, seq, body and crc
+#define MAX_PAYLOAD (2 + TELEMETRY_MAX_BODY + 2)
+// COBS adds one byte per 254 plus the trailing delimiter
+#define MAX_FRAME (MAX_PAYLOAD + 2)
+
+static uint8_t seq_;
+
+bool telemetry_send(telemetry_type type, const void *body, uint8_t len) {
+    uint8_t payload[MAX_PAYLOAD];
+    payload[0] = type;
+    payload[1] = seq_++;
+    const uint8_t *b = (const uint8_t *)body;
+    for (uint8_t i = 0; i < len; i++) {
+        payload[2 + i] = b[i];
+    }
+    len += 2;
+
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < len; i++) {
+        crc = _crc_ccitt_update(crc, payload[i]);
+    }
+    payload[len++] = crc & 0xFF;
+    payload[len++] = crc >> 8;
+
+    // COBS: replace each zero with the distance to the next one. Frames are far
+    // shorter than 254 bytes so there are never any overhead bytes mid-frame.
+    uint8_t frame[MAX_FRAME];
+    uint8_t code_idx = 0, out = 1;
+    for (uint8_t i = 0; i < len; i++) {
+        if (payload[i] == 0) {
+            frame[code_idx] = out - code_idx;
+            code_idx = out++;
+        } else {
+            frame[out++] = payload[i];
+        }
+    }
+    frame[code_idx] = out - code_idx;
+    frame[out++] = 0;
+
+    return usart_debug_send_all(frame, out);
+}
+
+void telemetry_pressure(int32_t pa) { telemetry_send(TELEMETRY_TYPE_PRESSURE, &pa, sizeof(pa)); }
+
+void telemetry_delta(int8_t delta) { telemetry_send(TELEMETRY_TYPE_DELTA, &delta, sizeof(delta)); }
+
+void telemetry_state(telemetry_flight_state state, uint16_t n_records) {
+    struct telemetry_state_body body = {state, n_records};
+    telemetry_send(TELEMETRY_TYPE_STATE, &body, sizeof(body));
+}
+
+void telemetry_phase(uint8_t phase) { telemetry_send(TELEMETRY_TYPE_PHASE, &phase, sizeof(phase)); }
+
+void telemetry_filter(int32_t altitude, int32_t velocity) {
+    struct telemetry_filter_body body = {altitude, velocity};
+    telemetry_send(TELEMETRY_TYPE_FILTER, &body, sizeof(body));
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifdef TICK_PROFILER
+
+#include "tick_profiler.h"
+
+#include <string.h>
+
+#include "avr/eeprom.h"
+#include "avr/io.h"
+
+#include "clock.h"
+#include "telemetry.h"
+#include "usart_debug.h"
+
+// F_CLK_PER cycles per RTC count, rounded down from 38.1
+#define WAKE_TIMER_CLK_DIV (F_CLK_PER / RTC_HZ)
+
+struct tick_profiler_stats {
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+    uint16_t count;
+    // Saturating counts of ticks by cycles: <256, <512, ... <16k, >=16k
+    uint8_t buckets[TICK_PROFILER_N_BUCKETS];
+};
+
+static tick_profiler_stats stats_[TICK_N_PHASES];
+static uint16_t tick_cycles_[TICK_N_PHASES];
+static uint8_t tick_seen_; // Bitmask of phases hit this tick
+static uint16_t last_cnt_;
+// F_CLK_PER cycles since the last mark that ran at a previous clock speed
+static uint16_t banked_;
+
+void tick_profiler_init() {
+    for (uint8_t i = 0; i < TICK_N_PHASES; i++) {
+        stats_[i].min = UINT16_MAX;
+    }
+
+    // Free-running 16-bit counter at CLK_PER. Each stretch between marks or clock
+    // changes is well under one wrap (210ms at 312.5khz, 13ms at 5mhz) so unsigned
+    // subtraction gives elapsed cycles, shifted down to F_CLK_PER cycles.
+    TCB0.CCMP = 0xFFFF;
+    TCB0.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB0.CTRLA = TCB_CLKSEL_DIV1_gc | TCB_ENABLE_bm;
+}
+
+void tick_profiler_start() {
+    last_cnt_ = TCB0.CNT;
+    banked_ = 0;
+    // The RTC restarts from zero on the overflow that woke us so its count is our wake latency
+    tick_cycles_[TICK_PHASE_WAKE] = RTC.CNT * WAKE_TIMER_CLK_DIV;
+    tick_seen_ = 1 << TICK_PHASE_WAKE;
+}
+
+void tick_profiler_mark(tick_phase phase) {
+    uint16_t cnt = TCB0.CNT;
+    uint16_t cycles = banked_ + ((uint16_t)(cnt - last_cnt_) >> clock_shift());
+    if (tick_seen_ & (1 << phase)) {
+        tick_cycles_[phase] += cycles;
+    } else {
+        tick_cycles_[phase] = cycles;
+        tick_seen_ |= 1 << phase;
+    }
+    last_cnt_ = cnt;
+    banked_ = 0;
+}
+
+void tick_profiler_clock_change() {
+    uint16_t cnt = TCB0.CNT;
+    banked_ += (uint16_t)(cnt - last_cnt_) >> clock_shift();
+    last_cnt_ = cnt;
+}
+
+void tick_profiler_end() {
+    for (uint8_t i = 0; i < TICK_N_PHASES; i++) {
+        if (!(tick_seen_ & (1 << i))) {
+            continue;
+        }
+        uint16_t cycles = tick_cycles_[i];
+        tick_profiler_stats *s = &stats_[i];
+        if (cycles < s->min) {
+            s->min = cycles;
+        }
+        if (cycles > s->max) {
+            s->max = cycles;
+        }
+        s->sum += cycles;
+        s->count++;
+
+        uint8_t bucket = 0;
+        for (uint16_t c = cycles >> 8; c && bucket < TICK_PROFILER_N_BUCKETS - 1; c >>= 1) {
+            bucket++;
+        }
+        if (s->buckets[bucket] < UINT8_MAX) {
+            s->buckets[bucket]++;
+        }
+    }
+    tick_seen_ = 0;
+}
+
+void tick_profiler_dump() {
+    for (uint8_t i = 0; i < TICK_N_PHASES; i++) {
+        tick_profiler_stats *s = &stats_[i];
+        tick_profiler_summary summary = {0, 0, 0};
+        if (s->count) {
+            summary = {s->min, s->max, (uint16_t)(s->sum / s->count)};
+
+#ifdef USART_DEBUG
+            telemetry_timing_body timing = {i, s->count, summary.min, summary.avg, summary.max};
+            memcpy(timing.buckets, s->buckets, sizeof(timing.buckets));
+            // Wait for room rather than dropping, we're done sampling
+            USART_DEBUG_FLUSH();
+            telemetry_send(TELEMETRY_TYPE_TIMING, &timing, sizeof(timing));
+#endif
+        }
+
+#ifdef TICK_PROFILER_EEPROM
+        eeprom_update_block(&summary,
+                            (uint8_t *)(EEPROM_SIZE - TICK_PROFILER_EEPROM_SIZE +
+                                        i * sizeof(tick_profiler_summary)),
+                            sizeof(tick_profiler_summary));
+#endif
+    }
+}
+
+#endif
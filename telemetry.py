@@ -0,0 +1,157 @@
+"""
+Host side of the framed telemetry protocol in telemetry.h: COBS framing with a
+zero delimiter, a sequence number for drop detection and a CRC-16/MCRF4XX.
+"""
+import struct
+import time
+from collections import namedtuple
+
+from log_format import FLIGHT_PHASES
+
+# Must match telemetry_type in telemetry.h
+TYPE_PRESSURE = 1
+TYPE_DELTA = 2
+TYPE_STATE = 3
+TYPE_TIMING = 4
+TYPE_PHASE = 5
+TYPE_FILTER = 6
+
+# Must match telemetry_flight_state
+STATES = ('pad', 'recording', 'done', 'alert')
+
+# Must match tick_phase in tick_profiler.h
+PHASES = ('wake', 'trigger', 'conversion', 'i2c_read', 'compensation', 'delta', 'encode', 'eeprom')
+
+BODIES = {
+    TYPE_PRESSURE: struct.Struct('<i'),
+    TYPE_DELTA: struct.Struct('<b'),
+    TYPE_STATE: struct.Struct('<BH'),
+    TYPE_TIMING: struct.Struct('<BHHHH8B'),
+    TYPE_PHASE: struct.Struct('<B'),
+    TYPE_FILTER: struct.Struct('<ii'),
+}
+
+# timestamp is time.monotonic() when the frame's delimiter arrived, seq_gap the
+# number of frames lost immediately before this one
+Frame = namedtuple('Frame', ('timestamp', 'type', 'seq', 'fields', 'seq_gap'))
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/MCRF4XX, what avr-libc's _crc_ccitt_update computes from 0xFFFF"""
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_idx = 0
+    for b in data:
+        if b == 0:
+            out[code_idx] = len(out) - code_idx
+            code_idx = len(out)
+            out.append(0)
+        else:
+            out.append(b)
+            if len(out) - code_idx == 0xFF:
+                out[code_idx] = 0xFF
+                code_idx = len(out)
+                out.append(0)
+    out[code_idx] = len(out) - code_idx
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('bad COBS code')
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(type, seq, body):
+    payload = bytes([type, seq & 0xFF]) + body
+    return cobs_encode(payload + struct.pack('<H', crc16(payload))) + b'\x00'
+
+
+def encode_message(type, seq, *fields):
+    return encode_frame(type, seq, BODIES[type].pack(*fields))
+
+
+class Receiver:
+    """Incremental decoder: feed it bytes as they arrive, get complete frames back"""
+
+    def __init__(self, clock=time.monotonic):
+        self.clock = clock
+        self.buffer = bytearray()
+        self.last_seq = None
+        self.frames = 0
+        self.dropped = 0
+        self.bad_frames = 0
+
+    def feed(self, data):
+        frames = []
+        start = 0
+        while True:
+            end = data.find(b'\x00', start)
+            if end < 0:
+                self.buffer += data[start:]
+                return frames
+            self.buffer += data[start:end]
+            start = end + 1
+            frame = self._decode(bytes(self.buffer), self.clock())
+            self.buffer.clear()
+            if frame is not None:
+                frames.append(frame)
+
+    def _decode(self, encoded, timestamp):
+        if not encoded:
+            return None
+        try:
+            payload = cobs_decode(encoded)
+        except ValueError:
+            self.bad_frames += 1
+            return None
+        if len(payload) < 4 or crc16(payload[:-2]) != struct.unpack('<H', payload[-2:])[0]:
+            self.bad_frames += 1
+            return None
+
+        type, seq, body = payload[0], payload[1], payload[2:-2]
+        body_struct = BODIES.get(type)
+        if body_struct is None or len(body) != body_struct.size:
+            self.bad_frames += 1
+            return None
+
+        gap = 0 if self.last_seq is None else (seq - self.last_seq - 1) & 0xFF
+        self.last_seq = seq
+        self.dropped += gap
+        self.frames += 1
+        return Frame(timestamp, type, seq, body_struct.unpack(body), gap)
+
+
+def describe(frame):
+    f = frame.fields
+    if frame.type == TYPE_PRESSURE:
+        return 'pressure %dPa' % f
+    if frame.type == TYPE_DELTA:
+        return 'delta %+d' % f
+    if frame.type == TYPE_STATE:
+        state = STATES[f[0]] if f[0] < len(STATES) else f[0]
+        return 'state %s n_records %d' % (state, f[1])
+    if frame.type == TYPE_TIMING:
+        phase, count, mn, avg, mx = f[:5]
+        return 'timing %-12s n %d min %d avg %d max %d hist %s' % (
+            PHASES[phase], count, mn, avg, mx, ' '.join(str(b) for b in f[5:]))
+    if frame.type == TYPE_PHASE:
+        return 'phase %s' % (FLIGHT_PHASES[f[0]] if f[0] < len(FLIGHT_PHASES) else f[0])
+    if frame.type == TYPE_FILTER:
+        return 'filter altitude %.1fPa velocity %+.1fPa/s' % (f[0] / 256, f[1] / 256)
+    return 'type %d %s' % (frame.type, f)
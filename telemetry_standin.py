@@ -0,0 +1,49 @@
+"""
+Pretend to be the device: open a pseudo-terminal and stream telemetry frames of a
+simulated flight into it so uart_reader.py and telemetry.py can be exercised
+without hardware.
+
+    python telemetry_standin.py &
+    python uart_reader.py --port /dev/pts/N
+"""
+import os
+import random
+import time
+import tty
+
+import click
+
+from flight_sim import flight_pressure_fn, seeded_rng, simulate_flight
+from telemetry import TYPE_PRESSURE, encode_message
+
+
+@click.command()
+@click.option('--rate', default=8.0, help='Frames per second')
+@click.option('--drop', default=0.0, help='Probability of dropping each frame')
+@click.option('--corrupt', default=0.0, help='Probability of flipping a bit in each frame')
+@click.option('--seed', default=0)
+def main(rate, drop, corrupt, seed):
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    print(os.ttyname(slave), flush=True)
+
+    rng = random.Random(seed)
+    seq = 0
+    while True:
+        flight = simulate_flight('rocket', seeded_rng(seed, 'standin', seq))
+        pressure_at = flight_pressure_fn(flight, rng)
+        t = 0
+        while t < flight.times[-1]:
+            frame = bytearray(encode_message(TYPE_PRESSURE, seq, pressure_at(t)))
+            seq = (seq + 1) & 0xFF
+            t += 1 / rate
+            if rng.random() < drop:
+                continue
+            if rng.random() < corrupt:
+                frame[rng.randrange(len(frame) - 1)] ^= 1 << rng.randrange(8)
+            os.write(master, frame)
+            time.sleep(1 / rate)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,105 @@
+"""
+Decoding logs the recorder never got to commit or that share EEPROM with the tick
+profiler. Run from the repo root:
+
+    pipenv run python -m unittest discover test
+"""
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from flight_sim import Recorder, to_nibble  # noqa: E402
+from log_format import (EEPROM_SIZE, LOG_BLOCK_SIZE, LOG_HEADER, LOG_RECORDING, LOG_STOPPED,  # noqa: E402
+                        PROFILED_RECORDER_EEPROM_SIZE, PROFILES, RECORDER_EEPROM_SIZE, StreamDecoder,
+                        decode_blocks, feet_per_interval, parse_data, split_log)
+
+PROFILE = PROFILES['rocket']
+
+
+def dump(deltas, state, n_records=None, eeprom=None, size=RECORDER_EEPROM_SIZE):
+    """EEPROM after recording deltas with a summary of n_records, all of them by
+    default, committed only if state is LOG_STOPPED"""
+    recorder = Recorder(eeprom, size)
+    recorder.begin()
+    for d in deltas:
+        assert recorder.record(d)
+    if state == LOG_STOPPED:
+        recorder.commit()
+    recorder.write_header(0, 0, state, recorder.flight,
+                          len(deltas) if n_records is None else n_records, 0, 0, 0,
+                          PROFILE.FAST_INTERVAL_RTC)
+    return bytes(recorder.eeprom)
+
+
+def altitudes(data):
+    return [round(a / feet_per_interval(PROFILE)) for _, a in data[1:]]
+
+
+def streamed(eeprom, size=RECORDER_EEPROM_SIZE):
+    decoder = StreamDecoder(PROFILE, size)
+    samples = []
+    for b in eeprom:
+        samples += decoder.feed(bytes([b]))
+    samples += decoder.finish()
+    return [[s.time, s.altitude] for s in samples]
+
+
+class UncommittedLogTest(unittest.TestCase):
+    def test_first_block(self):
+        eeprom = dump([1] * 10, LOG_RECORDING)
+        self.assertEqual(eeprom[LOG_HEADER.size + LOG_BLOCK_SIZE - 1], 0xFF)
+        data = parse_data(eeprom, PROFILE)
+        self.assertEqual(altitudes(data), list(range(1, 11)))
+        self.assertEqual(streamed(eeprom), data)
+
+    def test_last_nibble_still_in_ram(self):
+        # The 11th record's only nibble waits for a 12th to fill its byte
+        data = parse_data(dump([1] * 11, LOG_RECORDING), PROFILE)
+        self.assertEqual(altitudes(data), list(range(1, 11)))
+
+    def test_second_block(self):
+        eeprom = dump([1, -1] * 75, LOG_RECORDING, n_records=140)
+        header, flight, log = split_log(eeprom)
+        self.assertEqual(eeprom[-1], 0xFF)  # The second block is the last, cut short
+        blocks = decode_blocks(log, flight, header=header)
+        self.assertTrue(blocks[0].verified)
+        self.assertFalse(blocks[1].verified)
+        data = parse_data(eeprom, PROFILE)
+        self.assertEqual(altitudes(data), [1, 0] * 70)
+        self.assertEqual(streamed(eeprom), data)
+
+    def test_stops_at_summary_over_old_flight(self):
+        # What's past the last write is an earlier flight's log, not erased EEPROM
+        old = dump([2] * 200, LOG_STOPPED)
+        data = parse_data(dump([1] * 20, LOG_RECORDING, n_records=16, eeprom=old), PROFILE)
+        self.assertEqual(altitudes(data), list(range(1, 17)))
+
+    def test_committed_log_unchanged(self):
+        eeprom = dump([1] * 11, LOG_STOPPED)
+        self.assertEqual(altitudes(parse_data(eeprom, PROFILE)), list(range(1, 12)))
+        self.assertEqual(len(eeprom), EEPROM_SIZE)
+
+
+
+class LogFromBeforeBlocksTest(unittest.TestCase):
+    def test_decodes(self):
+        # No header or checksums, just nibbles from the first byte
+        eeprom = bytes(to_nibble(1) | to_nibble(2) << 4 for _ in range(10))
+        self.assertEqual(altitudes(parse_data(eeprom, PROFILE)),
+                         [a for i in range(10) for a in (3 * i + 1, 3 * i + 3)])
+
+
+class TickProfilerDumpTest(unittest.TestCase):
+    def test_stats_after_log_ignored(self):
+        # Fills the first block and part of the short one the profiler leaves room for
+        eeprom = bytearray(dump([1, -1] * 60, LOG_STOPPED, size=PROFILED_RECORDER_EEPROM_SIZE))
+        eeprom[PROFILED_RECORDER_EEPROM_SIZE:] = bytes(range(EEPROM_SIZE - PROFILED_RECORDER_EEPROM_SIZE))
+        data = parse_data(eeprom, PROFILE, PROFILED_RECORDER_EEPROM_SIZE)
+        self.assertEqual(altitudes(data), [1, 0] * 60)
+        self.assertEqual(streamed(eeprom, PROFILED_RECORDER_EEPROM_SIZE), data)
+
+
+if __name__ == '__main__':
+    unittest.main()
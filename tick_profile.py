@@ -0,0 +1,17 @@
+"""
+Print the tick profiler stats saved at the top of an EEPROM dump from a
+-DTICK_PROFILER -DTICK_PROFILER_EEPROM build.
+"""
+import struct
+import sys
+
+from telemetry import PHASES
+SUMMARY = struct.Struct('<HHH')  # tick_profiler_summary: min, max, avg
+F_CLK_PER = 312500
+
+eeprom = open(sys.argv[1], 'rb').read()
+stats = eeprom[-len(PHASES) * SUMMARY.size:]
+for i, name in enumerate(PHASES):
+    mn, mx, avg = SUMMARY.unpack_from(stats, i * SUMMARY.size)
+    us = lambda c: round(c * 1e6 / F_CLK_PER)
+    print(f"{name:>12}  min {mn:>5} ({us(mn)}us)  avg {avg:>5} ({us(avg)}us)  max {mx:>5} ({us(mx)}us)")
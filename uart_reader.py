@@ -1,31 +1,41 @@
-import serial
+import csv
 import time
 
-def test_measuring_and_printing(ser):
-    while True:
-        s = ser.read(1)
-        if s == b'+':
-            break
-        print(s)
+import click
+import serial
 
-    ser.read(3)
+from telemetry import Receiver, describe
 
-    last = time.time()
-    while True:
-        bts = ser.read(4)
 
-        if len(bts) < 4:
-           continue
+@click.command()
+@click.option('--port', default='/dev/cu.usbserial-10')
+@click.option('--baud', default=9600)
+@click.option('--csv', 'csv_fn', type=click.Path(), help='Also log every frame to this CSV')
+def main(port, baud, csv_fn):
+    receiver = Receiver()
+    csv_f = open(csv_fn, 'w') if csv_fn else None
+    writer = csv.writer(csv_f) if csv_f else None
+    if writer:
+        writer.writerow(('timestamp', 'seq', 'type', 'fields', 'seq_gap'))
 
-        now = time.time()
-        # print("%s\t%s%d" % (":".join(hex(b) for b in bts[1:]), chr(bts[0]), int.from_bytes(bts[1:], 'little', signed=True)))
-        print("%dms\t%s%d" % (round((now - last)*1000), chr(bts[0]), int.from_bytes(bts[1:], 'little', signed=True)))
-        last = now
+    last = time.monotonic()
+    try:
+        with serial.Serial(port, baud, timeout=0.1) as ser:
+            while True:
+                for frame in receiver.feed(ser.read(ser.in_waiting or 1)):
+                    gap = '  (%d dropped)' % frame.seq_gap if frame.seq_gap else ''
+                    print("%dms\t%s%s" % (round((frame.timestamp - last) * 1000), describe(frame), gap))
+                    last = frame.timestamp
+                    if writer:
+                        writer.writerow((frame.timestamp, frame.seq, frame.type,
+                                         ' '.join(str(f) for f in frame.fields), frame.seq_gap))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv_f:
+            csv_f.close()
+        print("%d frames, %d dropped, %d bad" % (receiver.frames, receiver.dropped, receiver.bad_frames))
 
-def test_measuring_and_recording(ser):
-    while True:
-        print(int.from_bytes(ser.read(1), 'big', signed=True))
 
-with serial.Serial('/dev/cu.usbserial-10', 9600) as ser:
-    #test_measuring_and_printing(ser)
-    test_measuring_and_recording(ser)
+if __name__ == '__main__':
+    main()